@@ -0,0 +1,223 @@
+// Aho-Corasick multi-pattern literal search.
+//
+// Copyright (c) 2026 Johannes Overmann
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#include "AhoCorasick.hpp"
+#include "MiscUtils.hpp"
+#include "UnitTest.hpp"
+#include <algorithm>
+#include <deque>
+#include <stdexcept>
+
+namespace ut1
+{
+
+AhoCorasick::AhoCorasick(bool ignoreCase_)
+{
+    for (unsigned c = 0; c < 256; c++)
+    {
+        fold[c] = ignoreCase_ ? static_cast<unsigned char>(tolower(char(c))) : static_cast<unsigned char>(c);
+    }
+    nodes.emplace_back();
+}
+
+
+uint32_t AhoCorasick::getChild(uint32_t node, unsigned char c) const noexcept
+{
+    const auto& edges = nodes[node].edges;
+    auto        it    = std::lower_bound(edges.begin(), edges.end(), c, [](const std::pair<unsigned char, uint32_t>& edge, unsigned char key) { return edge.first < key; });
+    if ((it != edges.end()) && (it->first == c))
+    {
+        return it->second;
+    }
+    return kNone;
+}
+
+
+size_t AhoCorasick::addPattern(const std::string& pattern)
+{
+    if (pattern.empty())
+    {
+        throw std::invalid_argument("AhoCorasick::addPattern(): Empty pattern.");
+    }
+    uint32_t node = 0;
+    for (char ch: pattern)
+    {
+        unsigned char c     = fold[static_cast<unsigned char>(ch)];
+        uint32_t      child = getChild(node, c);
+        if (child == kNone)
+        {
+            child = uint32_t(nodes.size());
+            nodes.emplace_back();
+            nodes[child].depth = nodes[node].depth + 1;
+            auto& edges        = nodes[node].edges;
+            edges.insert(std::upper_bound(edges.begin(), edges.end(), std::make_pair(c, child)), std::make_pair(c, child));
+        }
+        node = child;
+    }
+    size_t index = patternLengths.size();
+    patternLengths.push_back(pattern.size());
+    if (nodes[node].pattern == kNone)
+    {
+        nodes[node].pattern = uint32_t(index);
+    }
+    return index;
+}
+
+
+void AhoCorasick::build()
+{
+    // Breadth first traversal: Failure links of a node only depend on nodes with a smaller depth.
+    rootTransitions.fill(0);
+    startBytes.fill(false);
+    std::deque<uint32_t> queue;
+    for (const auto& [c, child]: nodes[0].edges)
+    {
+        rootTransitions[c]  = child;
+        nodes[child].fail   = 0;
+        queue.push_back(child);
+    }
+    for (unsigned c = 0; c < 256; c++)
+    {
+        startBytes[c] = rootTransitions[fold[c]] != 0;
+    }
+    while (!queue.empty())
+    {
+        uint32_t node = queue.front();
+        queue.pop_front();
+        for (const auto& [c, child]: nodes[node].edges)
+        {
+            nodes[child].fail       = next(nodes[node].fail, c);
+            uint32_t fail           = nodes[child].fail;
+            nodes[child].outputLink = (nodes[fail].pattern != kNone) ? fail : nodes[fail].outputLink;
+            queue.push_back(child);
+        }
+    }
+}
+
+
+/// Apply patterns in a naive way (for testing).
+static std::vector<AhoCorasick::Match> findAllNaive(const std::vector<std::string>& patterns, const std::string& s)
+{
+    std::vector<AhoCorasick::Match> r;
+    for (size_t pos = 0; pos < s.size();)
+    {
+        AhoCorasick::Match best;
+        bool               found = false;
+        for (size_t i = 0; i < patterns.size(); i++)
+        {
+            size_t p = s.find(patterns[i], pos);
+            if ((p != std::string::npos) && ((!found) || (p < best.pos) || ((p == best.pos) && (patterns[i].size() > best.len))))
+            {
+                best  = {p, patterns[i].size(), i};
+                found = true;
+            }
+        }
+        if (!found)
+        {
+            break;
+        }
+        r.push_back(best);
+        pos = best.pos + best.len;
+    }
+    return r;
+}
+
+
+/// Find all leftmost-longest matches.
+static std::vector<AhoCorasick::Match> findAll(const AhoCorasick& ac, const std::string& s)
+{
+    std::vector<AhoCorasick::Match> r;
+    AhoCorasick::Match              match;
+    for (size_t pos = 0; ac.findLeftmostLongest(s, pos, match); pos = match.pos + match.len)
+    {
+        r.push_back(match);
+    }
+    return r;
+}
+
+
+UNIT_TEST(AhoCorasick)
+{
+    AhoCorasick ac;
+    ac.addPattern("he");
+    ac.addPattern("she");
+    ac.addPattern("his");
+    ac.addPattern("hers");
+    ac.build();
+    std::vector<AhoCorasick::Match> matches = findAll(ac, "ushers his");
+    ASSERT_EQ(matches.size(), size_t(2));
+    ASSERT_EQ(matches[0].pos, size_t(1));
+    ASSERT_EQ(matches[0].len, size_t(3));
+    ASSERT_EQ(matches[0].pattern, size_t(1));
+    ASSERT_EQ(matches[1].pos, size_t(7));
+    ASSERT_EQ(matches[1].pattern, size_t(2));
+
+    // Leftmost-longest.
+    AhoCorasick ac2;
+    ac2.addPattern("abcd");
+    ac2.addPattern("bc");
+    ac2.addPattern("ab");
+    ac2.addPattern("ab");
+    ac2.build();
+    matches = findAll(ac2, "xabcx abcd");
+    ASSERT_EQ(matches.size(), size_t(2));
+    ASSERT_EQ(matches[0].pos, size_t(1));
+    ASSERT_EQ(matches[0].pattern, size_t(2));
+    ASSERT_EQ(matches[1].pos, size_t(6));
+    ASSERT_EQ(matches[1].pattern, size_t(0));
+
+    // Rejected candidates do not hide shorter candidates.
+    AhoCorasick::Match match;
+    ASSERT_EQ(ac2.findLeftmostLongest("abcd", 0, match, [](size_t, size_t len, size_t) { return len != 4; }), true);
+    ASSERT_EQ(match.len, size_t(2));
+    ASSERT_EQ(match.pattern, size_t(2));
+
+    // Ignore case.
+    AhoCorasick ac3(true);
+    ac3.addPattern("FoO");
+    ac3.build();
+    ASSERT_EQ(ac3.findLeftmostLongest("xxfOo", 0, match), true);
+    ASSERT_EQ(match.pos, size_t(2));
+}
+
+
+UNIT_TEST(AhoCorasick_random)
+{
+    uint32_t seed = 1;
+    auto     rnd  = [&]() { seed = seed * 1103515245 + 12345; return (seed >> 16) & 0x7fff; };
+    for (int iteration = 0; iteration < 500; iteration++)
+    {
+        std::vector<std::string> patterns(1 + rnd() % 6);
+        AhoCorasick              ac;
+        for (std::string& pattern: patterns)
+        {
+            pattern.resize(1 + rnd() % 4);
+            for (char& c: pattern)
+            {
+                c = "abc"[rnd() % 3];
+            }
+            ac.addPattern(pattern);
+        }
+        ac.build();
+        std::string s(rnd() % 40, 'a');
+        for (char& c: s)
+        {
+            c = "abcd"[rnd() % 4];
+        }
+        std::vector<AhoCorasick::Match> ref    = findAllNaive(patterns, s);
+        std::vector<AhoCorasick::Match> result = findAll(ac, s);
+        ASSERT_EQ(result.size(), ref.size());
+        for (size_t i = 0; i < ref.size(); i++)
+        {
+            ASSERT_EQ(result[i].pos, ref[i].pos);
+            ASSERT_EQ(result[i].len, ref[i].len);
+            ASSERT_EQ(patterns[result[i].pattern], patterns[ref[i].pattern]);
+        }
+    }
+}
+
+} // namespace ut1
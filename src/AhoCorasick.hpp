@@ -0,0 +1,157 @@
+// Aho-Corasick multi-pattern literal search.
+//
+// Copyright (c) 2026 Johannes Overmann
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <cstdint>
+
+namespace ut1
+{
+
+/// Aho-Corasick automaton for searching many literal patterns in one pass.
+///
+/// Usage: Add all patterns using addPattern(), call build() and then call
+/// findLeftmostLongest() repeatedly to iterate over all non-overlapping
+/// matches from left to right.
+class AhoCorasick
+{
+public:
+    /// Match.
+    struct Match
+    {
+        size_t pos{};
+        size_t len{};
+        size_t pattern{};
+    };
+
+    /// Constructor.
+    /// ignoreCase compares ASCII letters case-insensitively.
+    explicit AhoCorasick(bool ignoreCase_ = false);
+
+    /// Add pattern and return its index.
+    /// Patterns must not be empty.
+    /// If the same pattern is added more than once, the first index is reported for matches.
+    size_t addPattern(const std::string& pattern);
+
+    /// Build failure links.
+    /// Call this after adding all patterns and before searching.
+    void build();
+
+    /// Get number of patterns.
+    size_t getNumPatterns() const noexcept { return patternLengths.size(); }
+
+    /// Find the leftmost-longest match in s at or after pos.
+    /// Among all matches starting at the leftmost position the longest match is returned.
+    /// accept(pos, len, pattern) may reject candidate matches (for example for whole-word matching).
+    /// Rejected candidates are ignored and do not hide other candidates.
+    /// Return false if there is no (accepted) match.
+    template<typename Accept>
+    bool findLeftmostLongest(std::string_view s, size_t pos, Match& match, Accept accept) const
+    {
+        bool     found = false;
+        uint32_t state = 0;
+        for (size_t i = pos; i < s.size(); i++)
+        {
+            unsigned char c = fold[static_cast<unsigned char>(s[i])];
+            if ((state == 0) && !found)
+            {
+                // Skip bytes which cannot start any pattern.
+                while (!startBytes[c])
+                {
+                    if (++i == s.size())
+                    {
+                        return false;
+                    }
+                    c = fold[static_cast<unsigned char>(s[i])];
+                }
+            }
+            state = next(state, c);
+
+            // Check all patterns ending at i (the longest first).
+            for (uint32_t o = (nodes[state].pattern != kNone) ? state : nodes[state].outputLink; o != kNone; o = nodes[o].outputLink)
+            {
+                const size_t len   = nodes[o].depth;
+                const size_t start = i + 1 - len;
+                if ((!found) || (start < match.pos) || ((start == match.pos) && (len > match.len)))
+                {
+                    if (accept(start, len, size_t(nodes[o].pattern)))
+                    {
+                        match.pos     = start;
+                        match.len     = len;
+                        match.pattern = nodes[o].pattern;
+                        found         = true;
+                    }
+                }
+            }
+
+            // Done as soon as no partial match can start at or before the best match.
+            if (found && (i + 1 - nodes[state].depth > match.pos))
+            {
+                return true;
+            }
+        }
+        return found;
+    }
+
+    /// Find the leftmost-longest match in s at or after pos.
+    bool findLeftmostLongest(std::string_view s, size_t pos, Match& match) const
+    {
+        return findLeftmostLongest(s, pos, match, [](size_t, size_t, size_t) { return true; });
+    }
+
+private:
+    static constexpr uint32_t kNone = ~uint32_t(0);
+
+    /// Trie node.
+    struct Node
+    {
+        /// Sorted outgoing edges (byte, node).
+        std::vector<std::pair<unsigned char, uint32_t>> edges;
+
+        /// Failure link (longest proper suffix which is also in the trie).
+        uint32_t fail{};
+
+        /// Next node along the failure links which ends a pattern.
+        uint32_t outputLink{kNone};
+
+        /// Index of the pattern ending at this node, or kNone.
+        uint32_t pattern{kNone};
+
+        /// Length of the string spelled by the path from the root to this node.
+        uint32_t depth{};
+    };
+
+    /// Get child of node for byte c or kNone.
+    uint32_t getChild(uint32_t node, unsigned char c) const noexcept;
+
+    /// Goto function including failure transitions.
+    uint32_t next(uint32_t state, unsigned char c) const noexcept
+    {
+        while (state != 0)
+        {
+            uint32_t child = getChild(state, c);
+            if (child != kNone)
+            {
+                return child;
+            }
+            state = nodes[state].fail;
+        }
+        return rootTransitions[c];
+    }
+
+    std::vector<Node>              nodes;
+    std::vector<size_t>            patternLengths;
+    std::array<uint32_t, 256>      rootTransitions{};
+    std::array<bool, 256>          startBytes{};
+    std::array<unsigned char, 256> fold{};
+};
+
+} // namespace ut1
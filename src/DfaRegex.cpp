@@ -0,0 +1,1436 @@
+// Linear-time regular expression engine (Thompson NFA / lazy DFA).
+//
+// Copyright (c) 2026 Johannes Overmann
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#include "DfaRegex.hpp"
+#include "MiscUtils.hpp"
+#include "UnitTest.hpp"
+#include <algorithm>
+#include <regex>
+
+namespace ut1
+{
+
+DfaRegex::Unsupported::~Unsupported() { }
+
+
+// --- Parser ---
+
+/// Recursive descent parser for ECMAScript regex syntax.
+class RegexParser
+{
+public:
+    RegexParser(const std::string& pattern_, bool ignoreCase_)
+    : pattern(pattern_)
+    , ignoreCase(ignoreCase_)
+    {
+    }
+
+    /// Parse whole pattern.
+    RegexNode parse()
+    {
+        RegexNode node = parseAlternation();
+        if (pos != pattern.size())
+        {
+            error("Unmatched ')'");
+        }
+        return node;
+    }
+
+    /// Number of capture groups.
+    unsigned numGroups{};
+
+private:
+    [[noreturn]] void error(const std::string& message) const
+    {
+        throw DfaRegex::Unsupported(message + " at position " + std::to_string(pos) + " in regex \"" + expandUnprintable(pattern) + "\"");
+    }
+
+    bool eof() const noexcept { return pos >= pattern.size(); }
+    char peek() const noexcept { return eof() ? '\0' : pattern[pos]; }
+
+    /// Make node matching a set of bytes.
+    RegexNode makeBytes(std::bitset<256> bytes) const
+    {
+        if (ignoreCase)
+        {
+            for (unsigned c = 0; c < 256; c++)
+            {
+                if (bytes.test(c))
+                {
+                    bytes.set(static_cast<unsigned char>(tolower(char(c))));
+                    bytes.set(static_cast<unsigned char>(toupper(char(c))));
+                }
+            }
+        }
+        RegexNode node;
+        node.type  = RegexNode::Type::BYTES;
+        node.bytes = bytes;
+        return node;
+    }
+
+    /// Make set containing a single byte.
+    static std::bitset<256> byteSet(char c)
+    {
+        std::bitset<256> r;
+        r.set(static_cast<unsigned char>(c));
+        return r;
+    }
+
+    /// Make set of all bytes for which pred is true.
+    template<typename Pred>
+    static std::bitset<256> byteSetIf(Pred pred)
+    {
+        std::bitset<256> r;
+        for (unsigned c = 0; c < 256; c++)
+        {
+            if (pred(static_cast<unsigned char>(c)))
+            {
+                r.set(c);
+            }
+        }
+        return r;
+    }
+
+    /// Get set for class escapes \d \D \w \W \s \S. Return false if c is not a class escape.
+    static bool getClassEscape(char c, std::bitset<256>& set)
+    {
+        switch (c)
+        {
+        case 'd': set = byteSetIf([](unsigned char ch) { return (ch >= '0') && (ch <= '9'); }); return true;
+        case 'w': set = byteSetIf([](unsigned char ch) { return isalnum_(char(ch)); }); return true;
+        case 's': set = byteSetIf([](unsigned char ch) { return (ch == ' ') || ((ch >= '\t') && (ch <= '\r')); }); return true;
+        case 'D': getClassEscape('d', set); set.flip(); return true;
+        case 'W': getClassEscape('w', set); set.flip(); return true;
+        case 'S': getClassEscape('s', set); set.flip(); return true;
+        default: return false;
+        }
+    }
+
+    /// Parse hex number with exactly n digits.
+    unsigned parseHex(unsigned n)
+    {
+        unsigned value = 0;
+        for (unsigned i = 0; i < n; i++)
+        {
+            char c = peek();
+            if (!std::isxdigit(static_cast<unsigned char>(c)))
+            {
+                error("Invalid hex escape");
+            }
+            pos++;
+            value = value * 16 + unsigned(std::isdigit(static_cast<unsigned char>(c)) ? c - '0' : tolower(c) - 'a' + 10);
+        }
+        return value;
+    }
+
+    /// Parse character escape (after the backslash) which denotes a single byte.
+    /// inClass: \b is backspace.
+    char parseCharEscape(bool inClass)
+    {
+        if (eof())
+        {
+            error("Trailing backslash");
+        }
+        char c = pattern[pos++];
+        switch (c)
+        {
+        case 'n': return '\n';
+        case 'r': return '\r';
+        case 't': return '\t';
+        case 'v': return '\v';
+        case 'f': return '\f';
+        case 'b':
+            if (inClass)
+            {
+                return '\b';
+            }
+            break;
+        case '0':
+            if (std::isdigit(static_cast<unsigned char>(peek())))
+            {
+                error("Octal escapes are not supported");
+            }
+            return '\0';
+        case 'x': return char(parseHex(2));
+        case 'u':
+        {
+            unsigned value = parseHex(4);
+            if (value > 0xff)
+            {
+                error("Unicode escapes above \\u00ff are not supported");
+            }
+            return char(value);
+        }
+        case 'c':
+            if (!std::isalpha(static_cast<unsigned char>(peek())))
+            {
+                error("Invalid control escape");
+            }
+            return char(pattern[pos++] % 32);
+        case 'k': error("Named backreferences are not supported");
+        default: break;
+        }
+        if ((c >= '1') && (c <= '9'))
+        {
+            error("Backreferences are not supported");
+        }
+        // Identity escape.
+        return c;
+    }
+
+    /// Parse alternation.
+    RegexNode parseAlternation()
+    {
+        RegexNode node = parseConcatenation();
+        if (peek() != '|')
+        {
+            return node;
+        }
+        RegexNode alt;
+        alt.type = RegexNode::Type::ALTERNATE;
+        alt.children.push_back(std::move(node));
+        while (peek() == '|')
+        {
+            pos++;
+            alt.children.push_back(parseConcatenation());
+        }
+        return alt;
+    }
+
+    /// Parse concatenation.
+    RegexNode parseConcatenation()
+    {
+        RegexNode node;
+        node.type = RegexNode::Type::CONCAT;
+        while ((!eof()) && (peek() != '|') && (peek() != ')'))
+        {
+            node.children.push_back(parseRepeat());
+        }
+        if (node.children.empty())
+        {
+            return RegexNode();
+        }
+        if (node.children.size() == 1)
+        {
+            return std::move(node.children[0]);
+        }
+        return node;
+    }
+
+    /// Parse unsigned decimal number. Return false if there is no number.
+    bool parseNumber(unsigned& value)
+    {
+        if (!std::isdigit(static_cast<unsigned char>(peek())))
+        {
+            return false;
+        }
+        value = 0;
+        while (std::isdigit(static_cast<unsigned char>(peek())))
+        {
+            value = value * 10 + unsigned(pattern[pos++] - '0');
+            if (value > 100000)
+            {
+                error("Repetition count too large");
+            }
+        }
+        return true;
+    }
+
+    /// Parse atom with optional quantifier.
+    RegexNode parseRepeat()
+    {
+        RegexNode atom = parseAtom();
+        unsigned  min  = 0;
+        unsigned  max  = 0;
+        switch (peek())
+        {
+        case '*': pos++; min = 0; max = RegexNode::kInfinite; break;
+        case '+': pos++; min = 1; max = RegexNode::kInfinite; break;
+        case '?': pos++; min = 0; max = 1; break;
+        case '{':
+            pos++;
+            if (!parseNumber(min))
+            {
+                error("Invalid repetition");
+            }
+            max = min;
+            if (peek() == ',')
+            {
+                pos++;
+                if (!parseNumber(max))
+                {
+                    max = RegexNode::kInfinite;
+                }
+            }
+            if ((peek() != '}') || (max < min))
+            {
+                error("Invalid repetition");
+            }
+            pos++;
+            break;
+        default: return atom;
+        }
+        if (atom.type == RegexNode::Type::ASSERT)
+        {
+            error("Nothing to repeat");
+        }
+        RegexNode node;
+        node.type = RegexNode::Type::REPEAT;
+        node.min  = min;
+        node.max  = max;
+        if (peek() == '?')
+        {
+            pos++;
+            node.greedy = false;
+        }
+        node.children.push_back(std::move(atom));
+        if ((peek() == '*') || (peek() == '+') || (peek() == '?') || (peek() == '{'))
+        {
+            error("Nothing to repeat");
+        }
+        return node;
+    }
+
+    /// Parse [...].
+    RegexNode parseClass()
+    {
+        std::bitset<256> set;
+        bool             negate = false;
+        if (peek() == '^')
+        {
+            pos++;
+            negate = true;
+        }
+        while (peek() != ']')
+        {
+            if (eof())
+            {
+                error("Unmatched '['");
+            }
+            std::bitset<256> itemSet;
+            char             lo      = 0;
+            bool             isRange = parseClassItem(lo, itemSet);
+            if (isRange && (peek() == '-') && (pos + 1 < pattern.size()) && (pattern[pos + 1] != ']'))
+            {
+                pos++;
+                std::bitset<256> hiSet;
+                char             hi = 0;
+                if (!parseClassItem(hi, hiSet))
+                {
+                    error("Invalid range");
+                }
+                if (static_cast<unsigned char>(hi) < static_cast<unsigned char>(lo))
+                {
+                    error("Invalid range");
+                }
+                for (unsigned c = static_cast<unsigned char>(lo); c <= static_cast<unsigned char>(hi); c++)
+                {
+                    itemSet.set(c);
+                }
+            }
+            set |= itemSet;
+        }
+        pos++;
+        RegexNode node = makeBytes(set);
+        if (negate)
+        {
+            node.bytes.flip();
+        }
+        return node;
+    }
+
+    /// Parse single class item into set.
+    /// Return true iff the item is a single byte (which may start a range) and return it in c.
+    bool parseClassItem(char& c, std::bitset<256>& set)
+    {
+        c = pattern[pos++];
+        if ((c == '[') && ((peek() == ':') || (peek() == '.') || (peek() == '=')))
+        {
+            char   kind = pattern[pos++];
+            size_t end  = pattern.find(std::string(1, kind) + "]", pos);
+            if ((kind != ':') || (end == std::string::npos))
+            {
+                error("Collating elements and equivalence classes are not supported");
+            }
+            std::string name = pattern.substr(pos, end - pos);
+            pos              = end + 2;
+            set              = getPosixClass(name);
+            return false;
+        }
+        if (c == '\\')
+        {
+            if (getClassEscape(peek(), set))
+            {
+                pos++;
+                return false;
+            }
+            c = parseCharEscape(true);
+        }
+        set.set(static_cast<unsigned char>(c));
+        return true;
+    }
+
+    /// Get POSIX class [:name:].
+    std::bitset<256> getPosixClass(const std::string& name)
+    {
+        using Pred = int (*)(int);
+        static const std::map<std::string, Pred> classes = {
+            {"alnum", std::isalnum}, {"alpha", std::isalpha}, {"blank", std::isblank}, {"cntrl", std::iscntrl},
+            {"digit", std::isdigit}, {"graph", std::isgraph}, {"lower", std::islower}, {"print", std::isprint},
+            {"punct", std::ispunct}, {"space", std::isspace}, {"upper", std::isupper}, {"xdigit", std::isxdigit},
+        };
+        if ((name == "w") || (name == "d") || (name == "s"))
+        {
+            std::bitset<256> set;
+            getClassEscape(name[0], set);
+            return set;
+        }
+        auto it = classes.find(name);
+        if (it == classes.end())
+        {
+            error("Unknown character class [:" + name + ":]");
+        }
+        Pred pred = it->second;
+        return byteSetIf([pred](unsigned char ch) { return (ch < 0x80) && pred(ch); });
+    }
+
+    /// Parse atom.
+    RegexNode parseAtom()
+    {
+        char c = pattern[pos++];
+        switch (c)
+        {
+        case '(':
+        {
+            RegexNode group;
+            group.type = RegexNode::Type::GROUP;
+            if (peek() == '?')
+            {
+                pos++;
+                if (peek() != ':')
+                {
+                    error("Lookahead and lookbehind assertions are not supported");
+                }
+                pos++;
+            }
+            else
+            {
+                group.group = ++numGroups;
+            }
+            group.children.push_back(parseAlternation());
+            if (peek() != ')')
+            {
+                error("Unmatched '('");
+            }
+            pos++;
+            return group;
+        }
+        case '[': return parseClass();
+        case '.': return makeBytes(byteSetIf([](unsigned char ch) { return (ch != '\n') && (ch != '\r'); }));
+        case '^':
+        case '$':
+        {
+            RegexNode node;
+            node.type      = RegexNode::Type::ASSERT;
+            node.assertion = (c == '^') ? RegexNode::Assertion::BOL : RegexNode::Assertion::EOL;
+            return node;
+        }
+        case '*':
+        case '+':
+        case '?':
+        case '{': error("Nothing to repeat");
+        case '\\':
+        {
+            std::bitset<256> set;
+            if (getClassEscape(peek(), set))
+            {
+                pos++;
+                return makeBytes(set);
+            }
+            if ((peek() == 'b') || (peek() == 'B'))
+            {
+                RegexNode node;
+                node.type      = RegexNode::Type::ASSERT;
+                node.assertion = (pattern[pos++] == 'b') ? RegexNode::Assertion::WORD_BOUNDARY : RegexNode::Assertion::NOT_WORD_BOUNDARY;
+                return node;
+            }
+            return makeBytes(byteSet(parseCharEscape(false)));
+        }
+        default: return makeBytes(byteSet(c));
+        }
+    }
+
+    const std::string& pattern;
+    bool               ignoreCase{};
+    size_t             pos{};
+};
+
+
+RegexNode parseRegex(const std::string& pattern, bool ignoreCase, unsigned* numGroupsOut)
+{
+    RegexParser parser(pattern, ignoreCase);
+    RegexNode   node = parser.parse();
+    if (numGroupsOut)
+    {
+        *numGroupsOut = parser.numGroups;
+    }
+    return node;
+}
+
+
+size_t getMaxMatchLength(const RegexNode& node)
+{
+    switch (node.type)
+    {
+    using enum RegexNode::Type;
+    case EMPTY:
+    case ASSERT: return 0;
+    case BYTES: return 1;
+    case GROUP: return getMaxMatchLength(node.children[0]);
+    case CONCAT:
+    {
+        size_t sum = 0;
+        for (const RegexNode& child: node.children)
+        {
+            size_t len = getMaxMatchLength(child);
+            if (len == std::string::npos)
+            {
+                return std::string::npos;
+            }
+            sum += len;
+        }
+        return sum;
+    }
+    case ALTERNATE:
+    {
+        size_t maxLen = 0;
+        for (const RegexNode& child: node.children)
+        {
+            size_t len = getMaxMatchLength(child);
+            if (len == std::string::npos)
+            {
+                return std::string::npos;
+            }
+            maxLen = std::max(maxLen, len);
+        }
+        return maxLen;
+    }
+    case REPEAT:
+    {
+        size_t len = getMaxMatchLength(node.children[0]);
+        if ((len == std::string::npos) || ((node.max == RegexNode::kInfinite) && (len > 0)))
+        {
+            return std::string::npos;
+        }
+        return (node.max == RegexNode::kInfinite) ? 0 : len * node.max;
+    }
+    default: return std::string::npos;
+    }
+}
+
+
+size_t getMinMatchLength(const RegexNode& node)
+{
+    switch (node.type)
+    {
+    using enum RegexNode::Type;
+    case BYTES: return 1;
+    case GROUP: return getMinMatchLength(node.children[0]);
+    case CONCAT:
+    {
+        size_t sum = 0;
+        for (const RegexNode& child: node.children)
+        {
+            sum += getMinMatchLength(child);
+        }
+        return sum;
+    }
+    case ALTERNATE:
+    {
+        size_t minLen = std::string::npos;
+        for (const RegexNode& child: node.children)
+        {
+            minLen = std::min(minLen, getMinMatchLength(child));
+        }
+        return (minLen == std::string::npos) ? 0 : minLen;
+    }
+    case REPEAT: return getMinMatchLength(node.children[0]) * node.min;
+    default: return 0;
+    }
+}
+
+
+bool canMatchByte(const RegexNode& node, char c)
+{
+    if (node.type == RegexNode::Type::BYTES)
+    {
+        return node.bytes.test(static_cast<unsigned char>(c));
+    }
+    if ((node.type == RegexNode::Type::REPEAT) && (node.max == 0))
+    {
+        return false;
+    }
+    return std::any_of(node.children.begin(), node.children.end(), [c](const RegexNode& child) { return canMatchByte(child, c); });
+}
+
+
+bool hasAssertion(const RegexNode& node, RegexNode::Assertion assertion)
+{
+    if (node.type == RegexNode::Type::ASSERT)
+    {
+        return node.assertion == assertion;
+    }
+    return std::any_of(node.children.begin(), node.children.end(), [assertion](const RegexNode& child) { return hasAssertion(child, assertion); });
+}
+
+
+/// Literals of a node used by getRequiredLiteral().
+struct LiteralInfo
+{
+    /// True iff the node matches exactly one string (then prefix, suffix and best are this string).
+    bool exact{};
+
+    /// Literal all matches start with.
+    std::string prefix;
+
+    /// Literal all matches end with.
+    std::string suffix;
+
+    /// Longest literal contained in all matches.
+    std::string best;
+};
+
+
+/// Repeated exact literals are only expanded up to this length.
+static constexpr size_t kMaxRepeatedLiteralLength = 64;
+
+
+/// Keep the longer of best and candidate in best.
+static void keepLonger(std::string& best, const std::string& candidate)
+{
+    if (candidate.size() > best.size())
+    {
+        best = candidate;
+    }
+}
+
+
+/// Return true iff bytes matches a single char (or a single letter in both cases if ignoreCase is true).
+static bool getLiteralByte(const std::bitset<256>& bytes, bool ignoreCase, char& c)
+{
+    if ((bytes.count() != 1) && !((bytes.count() == 2) && ignoreCase))
+    {
+        return false;
+    }
+    unsigned first = 0;
+    while (!bytes.test(first))
+    {
+        first++;
+    }
+    c = char(first);
+    if (bytes.count() == 2)
+    {
+        // Must be the upper and lowercase variant of the same letter.
+        c = tolower(c);
+        return (c != char(first)) && bytes.test(static_cast<unsigned char>(c));
+    }
+    return true;
+}
+
+
+static LiteralInfo getLiteralInfo(const RegexNode& node, bool ignoreCase)
+{
+    LiteralInfo r;
+    switch (node.type)
+    {
+    using enum RegexNode::Type;
+    case EMPTY:
+    case ASSERT:
+        r.exact = true;
+        break;
+    case BYTES:
+    {
+        char c{};
+        if (getLiteralByte(node.bytes, ignoreCase, c))
+        {
+            r.exact  = true;
+            r.prefix = std::string(1, ignoreCase ? tolower(c) : c);
+            r.suffix = r.best = r.prefix;
+        }
+        break;
+    }
+    case GROUP:
+        r = getLiteralInfo(node.children[0], ignoreCase);
+        break;
+    case CONCAT:
+    {
+        // run is the literal which is known to precede the current position in all matches.
+        std::string run;
+        bool        allExact = true;
+        for (const RegexNode& child: node.children)
+        {
+            LiteralInfo info = getLiteralInfo(child, ignoreCase);
+            run += info.prefix;
+            if (info.exact)
+            {
+                continue;
+            }
+            if (allExact)
+            {
+                r.prefix = run;
+                allExact = false;
+            }
+            keepLonger(r.best, run);
+            keepLonger(r.best, info.best);
+            run = info.suffix;
+        }
+        r.exact  = allExact;
+        r.suffix = run;
+        if (allExact)
+        {
+            r.prefix = run;
+        }
+        keepLonger(r.best, run);
+        break;
+    }
+    case REPEAT:
+    {
+        if (node.min == 0)
+        {
+            break;
+        }
+        LiteralInfo info = getLiteralInfo(node.children[0], ignoreCase);
+        if (info.exact && (info.prefix.size() * node.min <= kMaxRepeatedLiteralLength))
+        {
+            std::string repeated;
+            for (unsigned i = 0; i < node.min; i++)
+            {
+                repeated += info.prefix;
+            }
+            if (node.min == node.max)
+            {
+                r.exact  = true;
+                r.prefix = r.suffix = r.best = repeated;
+                break;
+            }
+            info.best = repeated;
+            info.exact = false;
+        }
+        r        = info;
+        r.exact  = false;
+        break;
+    }
+    default:
+        // Alternatives do not have a common literal (common prefixes of alternatives are not extracted).
+        break;
+    }
+    return r;
+}
+
+
+std::string getRequiredLiteral(const RegexNode& node, bool ignoreCase)
+{
+    return getLiteralInfo(node, ignoreCase).best;
+}
+
+
+UNIT_TEST(parseRegex)
+{
+    unsigned numGroups = 0;
+    ASSERT_EQ(getMaxMatchLength(parseRegex("abc", false)), size_t(3));
+    ASSERT_EQ(getMaxMatchLength(parseRegex("a(b|cd)?e{2,4}", false, &numGroups)), size_t(7));
+    ASSERT_EQ(numGroups, 1u);
+    ASSERT_EQ(getMaxMatchLength(parseRegex("ab*", false)), std::string::npos);
+    ASSERT_EQ(getMaxMatchLength(parseRegex("^(?:)*$", false)), size_t(0));
+    ASSERT_EQ(canMatchByte(parseRegex("a.*b", false), '\n'), false);
+    ASSERT_EQ(canMatchByte(parseRegex("a[^x]*b", false), '\n'), true);
+    ASSERT_EQ(canMatchByte(parseRegex("a\\s", false), '\n'), true);
+    ASSERT_EQ(canMatchByte(parseRegex("A", true), 'a'), true);
+    ASSERT_EQ(getMinMatchLength(parseRegex("a(b|cd)?e{2,4}", false)), size_t(3));
+    ASSERT_EQ(getMinMatchLength(parseRegex("x*|ab", false)), size_t(0));
+    ASSERT_EQ(getMinMatchLength(parseRegex("\\bab+", false)), size_t(2));
+    ASSERT_EQ(hasAssertion(parseRegex("(a|^b)", false), RegexNode::Assertion::BOL), true);
+    ASSERT_EQ(hasAssertion(parseRegex("\\ba$", false), RegexNode::Assertion::BOL), false);
+    for (const char* unsupported: {"(a)\\1", "a(?=b)", "a(?!b)", "(a", "a)", "*a", "a{2,1}", "[b-a]", "a**", "\\", "[[.a.]]"})
+    {
+        bool thrown = false;
+        try
+        {
+            parseRegex(unsupported, false);
+        }
+        catch (const DfaRegex::Unsupported&)
+        {
+            thrown = true;
+        }
+        ASSERT_EQ(thrown, true);
+    }
+}
+
+
+UNIT_TEST(getRequiredLiteral)
+{
+    ASSERT_EQ(getRequiredLiteral(parseRegex("old_api_([a-z]+)\\(", false), false), std::string("old_api_"));
+    ASSERT_EQ(getRequiredLiteral(parseRegex("\\bfoo\\b", false), false), std::string("foo"));
+    ASSERT_EQ(getRequiredLiteral(parseRegex("a+bcd?x(yz)", false), false), std::string("abc"));
+    ASSERT_EQ(getRequiredLiteral(parseRegex("[0-9]+(?:xyz)[0-9]", false), false), std::string("xyz"));
+    ASSERT_EQ(getRequiredLiteral(parseRegex("x(ab){2}y", false), false), std::string("xababy"));
+    ASSERT_EQ(getRequiredLiteral(parseRegex("x(ab){2,}y", false), false), std::string("abab"));
+    ASSERT_EQ(getRequiredLiteral(parseRegex("Foo.Bar", true), true), std::string("foo"));
+    ASSERT_EQ(getRequiredLiteral(parseRegex("[fF]oo", false), false), std::string("oo"));
+    ASSERT_EQ(getRequiredLiteral(parseRegex("foo|bar", false), false), std::string());
+    ASSERT_EQ(getRequiredLiteral(parseRegex("(foo)?", false), false), std::string());
+    ASSERT_EQ(getRequiredLiteral(parseRegex("a*", false), false), std::string());
+    ASSERT_EQ(getRequiredLiteral(parseRegex("", false), false), std::string());
+}
+
+
+// --- Compiler ---
+
+static constexpr size_t kMaxProgramSize = 100000;
+static constexpr size_t kMaxDfaStates   = 4096;
+static constexpr uint32_t kRestoreFlag  = 0x80000000u;
+
+
+DfaRegex::DfaRegex(const std::string& pattern, bool ignoreCase)
+{
+    unsigned numCaptureGroups = 0;
+    ast                       = parseRegex(pattern, ignoreCase, &numCaptureGroups);
+    numGroups                 = numCaptureGroups + 1;
+
+    emit(Inst::Op::SAVE, 0);
+    compile(ast);
+    emit(Inst::Op::SAVE, 1);
+    emit(Inst::Op::MATCH);
+
+    // Byte equivalence classes: Bytes which are in exactly the same sets behave identically in the DFA.
+    std::map<std::vector<bool>, uint8_t> classes;
+    for (unsigned c = 0; c < 256; c++)
+    {
+        std::vector<bool> signature;
+        signature.reserve(byteSets.size());
+        for (const std::bitset<256>& set: byteSets)
+        {
+            signature.push_back(set.test(c));
+        }
+        auto [it, inserted] = classes.emplace(std::move(signature), uint8_t(classRepresentative.size()));
+        if (inserted)
+        {
+            classRepresentative.push_back(uint8_t(c));
+        }
+        byteClass[c] = it->second;
+    }
+
+    maxMatchLength  = getMaxMatchLength(ast);
+    canMatchNewline = canMatchByte(ast, '\n');
+
+    std::string literal = getRequiredLiteral(ast, ignoreCase);
+    if (!literal.empty())
+    {
+        prefilter.emplace(literal, ignoreCase);
+    }
+}
+
+
+uint32_t DfaRegex::emit(Inst::Op op, uint32_t x, uint32_t y)
+{
+    if (program.size() >= kMaxProgramSize)
+    {
+        throw Unsupported("Regex too large (too many repetitions)");
+    }
+    program.push_back({op, x, y});
+    return uint32_t(program.size() - 1);
+}
+
+
+void DfaRegex::compile(const RegexNode& node)
+{
+    switch (node.type)
+    {
+    using enum RegexNode::Type;
+    case EMPTY: break;
+    case BYTES:
+    {
+        auto it = std::find(byteSets.begin(), byteSets.end(), node.bytes);
+        if (it == byteSets.end())
+        {
+            it = byteSets.insert(byteSets.end(), node.bytes);
+        }
+        emit(Inst::Op::BYTES, uint32_t(it - byteSets.begin()));
+        break;
+    }
+    case CONCAT:
+        for (const RegexNode& child: node.children)
+        {
+            compile(child);
+        }
+        break;
+    case ALTERNATE:
+    {
+        std::vector<uint32_t> jumps;
+        for (size_t i = 0; i + 1 < node.children.size(); i++)
+        {
+            uint32_t split   = emit(Inst::Op::SPLIT);
+            program[split].x = split + 1;
+            compile(node.children[i]);
+            jumps.push_back(emit(Inst::Op::JMP));
+            program[split].y = uint32_t(program.size());
+        }
+        compile(node.children.back());
+        for (uint32_t jump: jumps)
+        {
+            program[jump].x = uint32_t(program.size());
+        }
+        break;
+    }
+    case GROUP:
+        if (node.group)
+        {
+            emit(Inst::Op::SAVE, node.group * 2);
+        }
+        compile(node.children[0]);
+        if (node.group)
+        {
+            emit(Inst::Op::SAVE, node.group * 2 + 1);
+        }
+        break;
+    case ASSERT:
+        emit(Inst::Op::ASSERT, uint32_t(node.assertion));
+        if ((node.assertion == RegexNode::Assertion::WORD_BOUNDARY) || (node.assertion == RegexNode::Assertion::NOT_WORD_BOUNDARY))
+        {
+            useDfa = false;
+        }
+        break;
+    case REPEAT:
+    {
+        for (unsigned i = 0; i < node.min; i++)
+        {
+            compile(node.children[0]);
+        }
+        if (node.max == RegexNode::kInfinite)
+        {
+            uint32_t split = emit(Inst::Op::SPLIT);
+            compile(node.children[0]);
+            emit(Inst::Op::JMP, split);
+            uint32_t end     = uint32_t(program.size());
+            program[split].x = node.greedy ? split + 1 : end;
+            program[split].y = node.greedy ? end : split + 1;
+        }
+        else
+        {
+            std::vector<uint32_t> splits;
+            for (unsigned i = node.min; i < node.max; i++)
+            {
+                splits.push_back(emit(Inst::Op::SPLIT));
+                compile(node.children[0]);
+            }
+            uint32_t end = uint32_t(program.size());
+            for (uint32_t split: splits)
+            {
+                program[split].x = node.greedy ? split + 1 : end;
+                program[split].y = node.greedy ? end : split + 1;
+            }
+        }
+        break;
+    }
+    }
+}
+
+
+// --- Matching ---
+
+void DfaRegex::Cache::clear()
+{
+    owner = nullptr;
+    states.clear();
+    transitions.clear();
+    stateIndex.clear();
+    startStates = {-1, -1};
+}
+
+
+void DfaRegex::prepareCache(Cache& cache) const
+{
+    if (cache.owner == this)
+    {
+        return;
+    }
+    cache.clear();
+    cache.owner = this;
+    for (Cache::ThreadList* list: {&cache.clist, &cache.nlist, &cache.closureSet})
+    {
+        list->dense.assign(program.size(), 0);
+        list->sparse.assign(program.size(), 0);
+        list->size = 0;
+    }
+    cache.clist.caps.assign(program.size() * numGroups * 2, std::string::npos);
+    cache.nlist.caps.assign(program.size() * numGroups * 2, std::string::npos);
+    cache.scratch.assign(numGroups * 2, std::string::npos);
+}
+
+
+bool DfaRegex::checkAssertion(RegexNode::Assertion assertion, std::string_view s, size_t pos, unsigned flags) const noexcept
+{
+    switch (assertion)
+    {
+    using enum RegexNode::Assertion;
+    case BOL: return (pos == 0) && !(flags & kNotBol);
+    case EOL: return (pos == s.size()) && !(flags & kNotEol);
+    case WORD_BOUNDARY:
+    case NOT_WORD_BOUNDARY:
+    {
+        bool before   = (pos > 0) && isalnum_(s[pos - 1]);
+        bool after    = (pos < s.size()) && isalnum_(s[pos]);
+        bool boundary = before != after;
+        return (assertion == WORD_BOUNDARY) ? boundary : !boundary;
+    }
+    default: return false;
+    }
+}
+
+
+void DfaRegex::addThread(Cache::ThreadList& list, uint32_t pc0, std::string_view s, size_t pos, unsigned flags, Cache& cache) const
+{
+    const size_t numCaps = numGroups * 2;
+    auto&        stack   = cache.stack;
+    auto&        scratch = cache.scratch;
+    stack.clear();
+    stack.emplace_back(pc0, 0);
+    while (!stack.empty())
+    {
+        auto [code, value] = stack.back();
+        stack.pop_back();
+        if (code & kRestoreFlag)
+        {
+            scratch[code & ~kRestoreFlag] = value;
+            continue;
+        }
+        uint32_t pc = code;
+        while (!list.contains(pc))
+        {
+            list.insert(pc);
+            const Inst& inst = program[pc];
+            if ((inst.op == Inst::Op::BYTES) || (inst.op == Inst::Op::MATCH))
+            {
+                std::copy(scratch.begin(), scratch.end(), list.caps.begin() + ptrdiff_t(pc * numCaps));
+                break;
+            }
+            else if (inst.op == Inst::Op::JMP)
+            {
+                pc = inst.x;
+            }
+            else if (inst.op == Inst::Op::SPLIT)
+            {
+                stack.emplace_back(inst.y, 0);
+                pc = inst.x;
+            }
+            else if (inst.op == Inst::Op::SAVE)
+            {
+                stack.emplace_back(kRestoreFlag | inst.x, scratch[inst.x]);
+                scratch[inst.x] = pos;
+                pc++;
+            }
+            else if (checkAssertion(RegexNode::Assertion(inst.x), s, pos, flags))
+            {
+                pc++;
+            }
+            else
+            {
+                break;
+            }
+        }
+    }
+}
+
+
+bool DfaRegex::pikeVm(std::string_view s, size_t start, Match& match, Cache& cache, unsigned flags) const
+{
+    const size_t numCaps = numGroups * 2;
+    bool         matched = false;
+    cache.clist.size     = 0;
+    for (size_t pos = start;; pos++)
+    {
+        // Start a new thread at each position (with the lowest priority) until a match is found.
+        if ((!matched) && ((pos == start) || !(flags & kContinuous)))
+        {
+            std::fill(cache.scratch.begin(), cache.scratch.end(), std::string::npos);
+            addThread(cache.clist, 0, s, pos, flags, cache);
+        }
+        if (cache.clist.size == 0)
+        {
+            if (matched || (flags & kContinuous) || (pos >= s.size()))
+            {
+                break;
+            }
+            continue;
+        }
+
+        cache.nlist.size = 0;
+        for (size_t i = 0; i < cache.clist.size; i++)
+        {
+            const uint32_t pc   = cache.clist.dense[i];
+            const Inst&    inst = program[pc];
+            auto           caps = cache.clist.caps.begin() + ptrdiff_t(pc * numCaps);
+            if (inst.op == Inst::Op::MATCH)
+            {
+                if ((flags & kNotNull) && (caps[0] == pos))
+                {
+                    continue;
+                }
+                matched = true;
+                match.caps.assign(caps, caps + ptrdiff_t(numCaps));
+                // Cut off all threads with a lower priority.
+                break;
+            }
+            if ((inst.op == Inst::Op::BYTES) && (pos < s.size()) && byteSets[inst.x].test(static_cast<unsigned char>(s[pos])))
+            {
+                std::copy(caps, caps + ptrdiff_t(numCaps), cache.scratch.begin());
+                addThread(cache.nlist, pc + 1, s, pos + 1, flags, cache);
+            }
+        }
+        std::swap(cache.clist, cache.nlist);
+        if (pos >= s.size())
+        {
+            break;
+        }
+    }
+    return matched;
+}
+
+
+void DfaRegex::closure(const std::vector<uint32_t>& seeds, bool atStart, bool atEnd, std::vector<uint32_t>& leaves, Cache& cache) const
+{
+    auto& visited = cache.closureSet;
+    auto& stack   = cache.closureStack;
+    visited.size  = 0;
+    leaves.clear();
+    stack.assign(seeds.rbegin(), seeds.rend());
+    while (!stack.empty())
+    {
+        uint32_t pc = stack.back();
+        stack.pop_back();
+        if (visited.contains(pc))
+        {
+            continue;
+        }
+        visited.insert(pc);
+        const Inst& inst = program[pc];
+        switch (inst.op)
+        {
+        case Inst::Op::BYTES:
+        case Inst::Op::MATCH: leaves.push_back(pc); break;
+        case Inst::Op::JMP: stack.push_back(inst.x); break;
+        case Inst::Op::SPLIT:
+            stack.push_back(inst.y);
+            stack.push_back(inst.x);
+            break;
+        case Inst::Op::SAVE: stack.push_back(pc + 1); break;
+        case Inst::Op::ASSERT:
+            if (RegexNode::Assertion(inst.x) == RegexNode::Assertion::BOL)
+            {
+                if (atStart)
+                {
+                    stack.push_back(pc + 1);
+                }
+            }
+            else if (atEnd)
+            {
+                stack.push_back(pc + 1);
+            }
+            else
+            {
+                // Keep $ as a leaf to be able to decide whether this state matches at the end of the input.
+                leaves.push_back(pc);
+            }
+            break;
+        }
+    }
+    std::sort(leaves.begin(), leaves.end());
+}
+
+
+int32_t DfaRegex::getDfaState(const std::vector<uint32_t>& seeds, bool atStart, Cache& cache) const
+{
+    std::vector<uint32_t> leaves;
+    closure(seeds, atStart, false, leaves, cache);
+    auto it = cache.stateIndex.find(leaves);
+    if (it != cache.stateIndex.end())
+    {
+        return it->second;
+    }
+
+    if (cache.states.size() >= kMaxDfaStates)
+    {
+        // Cache full: Start over.
+        cache.states.clear();
+        cache.transitions.clear();
+        cache.stateIndex.clear();
+        cache.startStates = {-1, -1};
+    }
+
+    Cache::DfaState state;
+    std::vector<uint32_t> eolSeeds;
+    for (uint32_t pc: leaves)
+    {
+        if (program[pc].op == Inst::Op::MATCH)
+        {
+            state.isMatch = true;
+        }
+        else if (program[pc].op == Inst::Op::ASSERT)
+        {
+            eolSeeds.push_back(pc);
+        }
+    }
+    state.isMatchAtEnd = state.isMatch;
+    if ((!state.isMatch) && (!eolSeeds.empty()))
+    {
+        std::vector<uint32_t> endLeaves;
+        closure(eolSeeds, false, true, endLeaves, cache);
+        state.isMatchAtEnd = std::any_of(endLeaves.begin(), endLeaves.end(), [this](uint32_t pc) { return program[pc].op == Inst::Op::MATCH; });
+    }
+    state.leaves = leaves;
+    int32_t index = int32_t(cache.states.size());
+    cache.states.push_back(std::move(state));
+    cache.transitions.resize(cache.states.size() * classRepresentative.size(), -1);
+    cache.stateIndex.emplace(std::move(leaves), index);
+    return index;
+}
+
+
+int32_t DfaRegex::computeTransition(int32_t state, unsigned cls, Cache& cache) const
+{
+    const unsigned char   c = classRepresentative[cls];
+    std::vector<uint32_t> seeds;
+    for (uint32_t pc: cache.states[size_t(state)].leaves)
+    {
+        if ((program[pc].op == Inst::Op::BYTES) && byteSets[program[pc].x].test(c))
+        {
+            seeds.push_back(pc + 1);
+        }
+    }
+    // Unanchored search: A new match may start at each position.
+    seeds.push_back(0);
+    size_t  numStates = cache.states.size();
+    int32_t target    = getDfaState(seeds, false, cache);
+    if (cache.states.size() >= numStates)
+    {
+        cache.transitions[size_t(state) * classRepresentative.size() + cls] = target;
+    }
+    return target;
+}
+
+
+size_t DfaRegex::dfaScan(std::string_view s, size_t start, Cache& cache, unsigned flags) const
+{
+    const bool atStart = (start == 0) && !(flags & kNotBol);
+    int32_t&   startState = cache.startStates[atStart];
+    if (startState < 0)
+    {
+        startState = getDfaState({0}, atStart, cache);
+    }
+    int32_t state = startState;
+    if (cache.states[size_t(state)].isMatch)
+    {
+        return start;
+    }
+    const size_t numClasses = classRepresentative.size();
+    for (size_t i = start; i < s.size(); i++)
+    {
+        const unsigned cls  = byteClass[static_cast<unsigned char>(s[i])];
+        int32_t        next = cache.transitions[size_t(state) * numClasses + cls];
+        if (next < 0)
+        {
+            next = computeTransition(state, cls, cache);
+        }
+        state = next;
+        if (cache.states[size_t(state)].isMatch)
+        {
+            return i + 1;
+        }
+    }
+    if ((!(flags & kNotEol)) && cache.states[size_t(state)].isMatchAtEnd)
+    {
+        return s.size();
+    }
+    return std::string::npos;
+}
+
+
+bool DfaRegex::search(std::string_view s, size_t start, Match& match, Cache& cache, unsigned flags, LineHint& line) const
+{
+    if ((!prefilter) || (flags & kContinuous) || (start > s.size()))
+    {
+        return searchRegion(s, start, match, cache, flags);
+    }
+
+    if (canMatchNewline)
+    {
+        // Reject the rest of the input if it does not contain the literal.
+        if (prefilter->find(s, start) == std::string::npos)
+        {
+            return false;
+        }
+        return searchRegion(s, start, match, cache, flags);
+    }
+
+    // Matches cannot span lines: Only search lines which contain the literal.
+    while (start <= s.size())
+    {
+        size_t pos = prefilter->find(s, start);
+        if (pos == std::string::npos)
+        {
+            return false;
+        }
+        // Both scans are bounded: Back to start and forward to the end of the line (only once per line, see LineHint).
+        size_t lineStart = s.substr(start, pos - start).rfind('\n');
+        lineStart        = (lineStart == std::string::npos) ? start : start + lineStart + 1;
+        if ((pos < line.begin) || (pos > line.end))
+        {
+            line.begin = pos;
+            line.end   = std::min(s.find('\n', pos), s.size());
+        }
+        size_t lineEnd = line.end;
+        if (lineEnd == s.size())
+        {
+            return searchRegion(s, lineStart, match, cache, flags);
+        }
+        if (searchRegion(s.substr(0, lineEnd), lineStart, match, cache, flags | kNotEol))
+        {
+            return true;
+        }
+        start = lineEnd + 1;
+    }
+    return false;
+}
+
+
+bool DfaRegex::searchRegion(std::string_view s, size_t start, Match& match, Cache& cache, unsigned flags) const
+{
+    if (start > s.size())
+    {
+        return false;
+    }
+    prepareCache(cache);
+
+    size_t vmStart = start;
+    if (useDfa && (start < s.size()) && !(flags & (kContinuous | kNotNull)))
+    {
+        // All matches end at or after matchEnd, so the leftmost match cannot start before
+        // matchEnd - maxMatchLength or before the last newline if the regex cannot match newlines.
+        size_t matchEnd = dfaScan(s, start, cache, flags);
+        if (matchEnd == std::string::npos)
+        {
+            return false;
+        }
+        if ((maxMatchLength != std::string::npos) && (matchEnd - start > maxMatchLength))
+        {
+            vmStart = matchEnd - maxMatchLength;
+        }
+        if (!canMatchNewline)
+        {
+            for (size_t i = matchEnd; i > vmStart; i--)
+            {
+                if (s[i - 1] == '\n')
+                {
+                    vmStart = i;
+                    break;
+                }
+            }
+        }
+    }
+    return pikeVm(s, vmStart, match, cache, flags);
+}
+
+
+/// Collect all matches of std::regex as strings (for testing).
+static std::vector<std::string> stdRegexMatches(const std::string& s, const std::string& pattern, bool ignoreCase)
+{
+    std::vector<std::string> r;
+    std::regex               re(pattern, ignoreCase ? std::regex::ECMAScript | std::regex::icase : std::regex::ECMAScript);
+    for (std::sregex_iterator it(s.begin(), s.end(), re), end; it != end; it++)
+    {
+        std::string m = std::to_string(it->position(0)) + ":";
+        for (size_t i = 0; i < it->size(); i++)
+        {
+            m += (*it)[i].matched ? "(" + (*it)[i].str() + ")" : "-";
+        }
+        r.push_back(m);
+    }
+    return r;
+}
+
+
+/// Collect all matches of DfaRegex as strings (for testing).
+static std::vector<std::string> dfaRegexMatches(const std::string& s, const std::string& pattern, bool ignoreCase)
+{
+    std::vector<std::string> r;
+    DfaRegex                 re(pattern, ignoreCase);
+    DfaRegex::Cache          cache;
+    re.forEachMatch(s, cache, [&](const DfaRegex::Match& match)
+        {
+            std::string m = std::to_string(match.position(0)) + ":";
+            for (size_t i = 0; i < match.size(); i++)
+            {
+                m += match.matched(i) ? "(" + s.substr(match.position(i), match.length(i)) + ")" : "-";
+            }
+            r.push_back(m);
+        });
+    return r;
+}
+
+
+UNIT_TEST(DfaRegex)
+{
+    const std::vector<std::string> patterns = {
+        "a", "ab|a", "a|ab", "a*", "a+?", "(a|b)*c", "(a*)(b*)", "x(a|b)?y", "[a-c]+", "[^a]", "^a", "a$", "^$", "$",
+        "\\bab\\b", "\\Bb", "a{2,3}", "a{2}", "a{2,}?", "(?:ab)+", "a.c", "\\d+", "\\w+", "\\s", "[[:alpha:]]+", "(a)|(b)",
+        "", "a??b", ".*", "[\\]a]", "\\x41", "\\.", "a|b|", "(a|ab)(c|bcd)(d*)", "[a-]+", "b*$", "(x)?a", "[\\d.]+",
+        "ab$", "^ab", "b\\w*", "\\sab", "a[^x]*b", "(ab){2}",
+    };
+    const std::vector<std::string> subjects = {
+        "", "a", "ab", "aab", "abc abc", "xaby", "ba\nab", "AaBb", "a1 b22.3 c", "aaaa", "abcd", "x-a-b", "ab\nb",
+        "ab\nab\n", "x\nab abab\nb", "\nab",
+    };
+    for (const std::string& pattern: patterns)
+    {
+        for (const std::string& subject: subjects)
+        {
+            ASSERT_EQ(dfaRegexMatches(subject, pattern, false), stdRegexMatches(subject, pattern, false));
+            ASSERT_EQ(dfaRegexMatches(subject, pattern, true), stdRegexMatches(subject, pattern, true));
+        }
+    }
+}
+
+
+UNIT_TEST(DfaRegex_longInput)
+{
+    // Memory use must not depend on the input length.
+    std::string s = "x" + std::string(1000000, 'a') + "y\"" + std::string(1000, 'b');
+    DfaRegex        re("x[^\"]*y");
+    DfaRegex::Cache cache;
+    DfaRegex::Match match;
+    ASSERT_EQ(re.search(s, 0, match, cache), true);
+    ASSERT_EQ(match.position(0), size_t(0));
+    ASSERT_EQ(match.length(0), size_t(1000002));
+    ASSERT_EQ(re.search(s, 1, match, cache), false);
+
+    // Many matches on long lines (the line end is reused for all matches on a line).
+    std::string lines;
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 1000; j++)
+        {
+            lines += (j % 3) ? "foo " : "xfoob ";
+        }
+        lines += "foo\n";
+    }
+    for (const std::string pattern: {"foo", "fo+b?", "x?foo\\b", "foo$", "^foo"})
+    {
+        ASSERT_EQ(dfaRegexMatches(lines, pattern, false), stdRegexMatches(lines, pattern, false));
+    }
+}
+
+} // namespace ut1
@@ -0,0 +1,296 @@
+// Linear-time regular expression engine (Thompson NFA / lazy DFA).
+//
+// Copyright (c) 2026 Johannes Overmann
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <bitset>
+#include <map>
+#include <stdexcept>
+#include <optional>
+#include <cstdint>
+#include "LiteralSearch.hpp"
+
+namespace ut1
+{
+
+/// Regular expression syntax tree node.
+struct RegexNode
+{
+    enum class Type { EMPTY, BYTES, CONCAT, ALTERNATE, REPEAT, GROUP, ASSERT };
+    enum class Assertion { BOL, EOL, WORD_BOUNDARY, NOT_WORD_BOUNDARY };
+    static constexpr unsigned kInfinite = ~0u;
+
+    Type type{Type::EMPTY};
+
+    /// BYTES: Set of bytes matched by this node.
+    std::bitset<256> bytes;
+
+    /// CONCAT, ALTERNATE: Any number of children. REPEAT, GROUP: Exactly one child.
+    std::vector<RegexNode> children;
+
+    /// REPEAT: Min/max number of repetitions (max may be kInfinite).
+    unsigned min{};
+    unsigned max{};
+    bool     greedy{true};
+
+    /// GROUP: Capture group index (1..n) or 0 for non-capturing groups.
+    unsigned group{};
+
+    /// ASSERT: Kind of assertion.
+    Assertion assertion{};
+};
+
+/// Parse regex in ECMAScript syntax (the subset supported by DfaRegex).
+/// Throw DfaRegex::Unsupported for syntax which is not supported (e.g. backreferences and lookahead) or which is invalid.
+/// Return number of capture groups (excluding group 0) in numGroupsOut.
+RegexNode parseRegex(const std::string& pattern, bool ignoreCase, unsigned* numGroupsOut = nullptr);
+
+/// Get maximum length of a match of node, or std::string::npos if unbounded.
+size_t getMaxMatchLength(const RegexNode& node);
+
+/// Get minimum length of a match of node.
+size_t getMinMatchLength(const RegexNode& node);
+
+/// Return true iff node can match a string containing byte c.
+bool canMatchByte(const RegexNode& node, char c);
+
+/// Return true iff node contains assertion.
+bool hasAssertion(const RegexNode& node, RegexNode::Assertion assertion);
+
+/// Get the longest literal which is contained in all matches of node, or an empty string if there is none.
+/// The literal is lowercase if ignoreCase is true.
+std::string getRequiredLiteral(const RegexNode& node, bool ignoreCase);
+
+
+/// Linear-time regex engine for the common subset of ECMAScript regex syntax:
+/// Literals, escapes, character classes, ., alternation, greedy and lazy
+/// repetition, ^, $, \b, \B and capture groups.
+///
+/// Matching semantics are leftmost-first (like backtracking engines),
+/// including submatch positions, but matching is done by a Thompson NFA
+/// simulation (Pike VM) which keeps one thread per NFA state. Time is
+/// O(pattern size * input size) and memory does not depend on the input size.
+/// A lazy DFA (built on demand and cached) is used to quickly skip input which
+/// cannot contain a match and to bound the region the Pike VM has to look at.
+/// If all matches contain a common literal, a fast literal search rejects input
+/// (or lines, if the regex cannot match newlines) without that literal first.
+class DfaRegex
+{
+public:
+    /// Exception for syntax which is not supported by this engine.
+    class Unsupported: public std::runtime_error
+    {
+    public:
+        explicit Unsupported(const std::string& message)
+        : std::runtime_error(message)
+        {
+        }
+        virtual ~Unsupported() override;
+    };
+
+    /// Search flags (can be or-ed together).
+    static constexpr unsigned kNotBol     = 1; ///< ^ does not match at position 0.
+    static constexpr unsigned kNotEol     = 2; ///< $ does not match at the end of the input.
+    static constexpr unsigned kContinuous = 4; ///< The match must start at the start position.
+    static constexpr unsigned kNotNull    = 8; ///< Empty matches are not allowed.
+
+    /// Match result.
+    class Match
+    {
+    public:
+        /// Number of groups including group 0 (the whole match).
+        size_t size() const noexcept { return caps.size() / 2; }
+
+        /// Return true iff group i participated in the match.
+        bool matched(size_t i) const noexcept { return (caps[i * 2] != std::string::npos) && (caps[i * 2 + 1] != std::string::npos); }
+
+        /// Start position of group i.
+        size_t position(size_t i = 0) const noexcept { return caps[i * 2]; }
+
+        /// Length of group i (0 if not matched).
+        size_t length(size_t i = 0) const noexcept { return matched(i) ? caps[i * 2 + 1] - caps[i * 2] : 0; }
+
+        /// End position of group i.
+        size_t end(size_t i = 0) const noexcept { return caps[i * 2 + 1]; }
+
+        /// Start/end positions of all groups (npos for unmatched groups).
+        std::vector<size_t> caps;
+    };
+
+    /// Mutable matching state (lazy DFA states and Pike VM thread lists).
+    /// A cache must only be used by one thread at a time.
+    class Cache
+    {
+    public:
+        /// Reset all state.
+        void clear();
+
+    private:
+        friend class DfaRegex;
+
+        /// Sparse set of NFA states with capture slots per state.
+        struct ThreadList
+        {
+            std::vector<uint32_t> dense;
+            std::vector<uint32_t> sparse;
+            std::vector<size_t>   caps;
+            size_t                size{};
+
+            bool contains(uint32_t pc) const noexcept { return (sparse[pc] < size) && (dense[sparse[pc]] == pc); }
+            void insert(uint32_t pc) noexcept { sparse[pc] = uint32_t(size); dense[size++] = pc; }
+        };
+
+        /// Lazy DFA state.
+        struct DfaState
+        {
+            std::vector<uint32_t> leaves;
+            bool                  isMatch{};
+            bool                  isMatchAtEnd{};
+        };
+
+        const DfaRegex*                          owner{};
+        ThreadList                               clist;
+        ThreadList                               nlist;
+        std::vector<size_t>                      scratch;
+        std::vector<std::pair<uint32_t, size_t>> stack;
+        std::vector<DfaState>                    states;
+        std::vector<int32_t>                     transitions;
+        std::map<std::vector<uint32_t>, int32_t> stateIndex;
+        std::array<int32_t, 2>                   startStates{-1, -1};
+        ThreadList                               closureSet;
+        std::vector<uint32_t>                    closureStack;
+    };
+
+    /// Constructor.
+    /// Throw Unsupported if the pattern uses unsupported syntax.
+    explicit DfaRegex(const std::string& pattern, bool ignoreCase = false);
+
+    /// Search for the leftmost match in s which starts at or after start.
+    /// Positions in the match are relative to s. ^ matches only at position 0 and $ only at s.size().
+    /// Return true iff a match was found.
+    bool search(std::string_view s, size_t start, Match& match, Cache& cache, unsigned flags = 0) const
+    {
+        LineHint line;
+        return search(s, start, match, cache, flags, line);
+    }
+
+    /// Call f(const Match&) for all matches in s, with the same semantics as std::regex_iterator (including empty matches).
+    template<typename F>
+    void forEachMatch(std::string_view s, Cache& cache, F f) const
+    {
+        // The end of the current line is found once for all matches on it (not once per match).
+        LineHint line;
+        Match    match;
+        size_t   pos   = 0;
+        bool     found = search(s, pos, match, cache, 0, line);
+        while (found)
+        {
+            f(match);
+            pos = match.end();
+            if (match.length() == 0)
+            {
+                if (pos == s.size())
+                {
+                    break;
+                }
+                if (search(s, pos, match, cache, kNotNull | kContinuous))
+                {
+                    continue;
+                }
+                pos++;
+            }
+            found = search(s, pos, match, cache, 0, line);
+        }
+    }
+
+    /// Get number of groups including group 0.
+    size_t getNumGroups() const noexcept { return numGroups; }
+
+    /// Get syntax tree.
+    const RegexNode& getAst() const noexcept { return ast; }
+
+    /// Get literal contained in all matches (used as a prefilter), or an empty string.
+    std::string getPrefilterLiteral() const { return prefilter ? prefilter->getNeedle() : std::string(); }
+
+private:
+    /// Line of the input of a sequence of searches: s[begin, end) contains no newline and end is a newline or the end of s.
+    struct LineHint
+    {
+        size_t begin{std::string::npos};
+        size_t end{};
+    };
+
+    /// Search (see search()). line is only valid for the same s.
+    bool search(std::string_view s, size_t start, Match& match, Cache& cache, unsigned flags, LineHint& line) const;
+
+    /// NFA instruction.
+    struct Inst
+    {
+        enum class Op : uint8_t { BYTES, SPLIT, JMP, SAVE, ASSERT, MATCH };
+        Op       op{};
+        uint32_t x{};
+        uint32_t y{};
+    };
+
+    /// Compile node into program.
+    void compile(const RegexNode& node);
+
+    /// Emit instruction and return its index.
+    uint32_t emit(Inst::Op op, uint32_t x = 0, uint32_t y = 0);
+
+    /// Return true iff assertion holds at pos.
+    bool checkAssertion(RegexNode::Assertion assertion, std::string_view s, size_t pos, unsigned flags) const noexcept;
+
+    /// Add thread for pc (following all epsilon transitions) to list.
+    void addThread(Cache::ThreadList& list, uint32_t pc, std::string_view s, size_t pos, unsigned flags, Cache& cache) const;
+
+    /// Search without the literal prefilter.
+    bool searchRegion(std::string_view s, size_t start, Match& match, Cache& cache, unsigned flags) const;
+
+    /// Run the Pike VM starting at start.
+    bool pikeVm(std::string_view s, size_t start, Match& match, Cache& cache, unsigned flags) const;
+
+    /// Run the lazy DFA (unanchored) and return the earliest end of any match at or after start, or npos.
+    size_t dfaScan(std::string_view s, size_t start, Cache& cache, unsigned flags) const;
+
+    /// Get/create DFA state for the epsilon closure of seeds.
+    int32_t getDfaState(const std::vector<uint32_t>& seeds, bool atStart, Cache& cache) const;
+
+    /// Compute epsilon closure (without captures) of seeds into leaves.
+    void closure(const std::vector<uint32_t>& seeds, bool atStart, bool atEnd, std::vector<uint32_t>& leaves, Cache& cache) const;
+
+    /// Compute DFA transition.
+    int32_t computeTransition(int32_t state, unsigned byteClass, Cache& cache) const;
+
+    /// Prepare cache for use with this regex.
+    void prepareCache(Cache& cache) const;
+
+    RegexNode                     ast;
+    size_t                        numGroups{};
+    std::vector<Inst>             program;
+    std::vector<std::bitset<256>> byteSets;
+
+    /// Byte equivalence classes for the DFA.
+    std::array<uint8_t, 256> byteClass{};
+    std::vector<uint8_t>     classRepresentative;
+
+    /// Bounds used to restrict the Pike VM region after the DFA found a match end.
+    size_t maxMatchLength{};
+    bool   canMatchNewline{};
+
+    /// Searcher for a literal contained in all matches.
+    std::optional<LiteralSearcher> prefilter;
+
+    /// The DFA cannot be used for word boundary assertions.
+    bool useDfa{true};
+};
+
+} // namespace ut1
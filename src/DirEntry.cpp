@@ -0,0 +1,425 @@
+// Directory traversal with file types from readdir() and directory-relative file operations.
+//
+// Copyright (c) 2026 Johannes Overmann
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#include "DirEntry.hpp"
+#include "UnitTest.hpp"
+#include <cerrno>
+#include <cstring>
+#include <format>
+#include <algorithm>
+#include <system_error>
+
+namespace ut1
+{
+
+#ifndef _WIN32
+/// Get file type from stat() mode.
+static FileType getFileTypeFromMode(mode_t mode)
+{
+    if (S_ISREG(mode))
+    {
+        return FileType::REGULAR;
+    }
+    else if (S_ISDIR(mode))
+    {
+        return FileType::DIR;
+    }
+    else if (S_ISLNK(mode))
+    {
+        return FileType::SYMLINK;
+    }
+    else if (S_ISFIFO(mode))
+    {
+        return FileType::FIFO;
+    }
+    else if (S_ISBLK(mode))
+    {
+        return FileType::BLOCK;
+    }
+    else if (S_ISCHR(mode))
+    {
+        return FileType::CHAR;
+    }
+    else if (S_ISSOCK(mode))
+    {
+        return FileType::SOCKET;
+    }
+    return FileType::NON_EXISTING;
+}
+#endif
+
+
+#ifndef _WIN32
+/// Get file type from d_type of a directory entry (fstatat() relative to dirFd for DT_UNKNOWN).
+static FileType getFileTypeFromDType(unsigned char dType, int dirFd, const char* name)
+{
+    switch (dType)
+    {
+    case DT_REG: return FileType::REGULAR;
+    case DT_DIR: return FileType::DIR;
+    case DT_LNK: return FileType::SYMLINK;
+    case DT_FIFO: return FileType::FIFO;
+    case DT_BLK: return FileType::BLOCK;
+    case DT_CHR: return FileType::CHAR;
+    case DT_SOCK: return FileType::SOCKET;
+    default: break;
+    }
+
+    // Filesystem does not report types.
+    struct stat st;
+    if (::fstatat(dirFd, name, &st, AT_SYMLINK_NOFOLLOW) == -1)
+    {
+        return FileType::NON_EXISTING;
+    }
+    return getFileTypeFromMode(st.st_mode);
+}
+
+
+/// Return true for "." and "..".
+static bool isDotOrDotDot(const char* name)
+{
+    return (name[0] == '.') && ((name[1] == 0) || ((name[1] == '.') && (name[2] == 0)));
+}
+#endif
+
+
+DirFd::~DirFd()
+{
+#ifndef _WIN32
+    if (fd >= 0)
+    {
+        ::close(fd);
+    }
+#endif
+}
+
+
+DirEntry::DirEntry(const std::filesystem::path& path_)
+: entryPath(path_)
+, entryType(getFileType(path_, false))
+{
+}
+
+
+int DirEntry::atFd() const noexcept
+{
+#ifdef _WIN32
+    return -1;
+#else
+    return parent ? parent->get() : AT_FDCWD;
+#endif
+}
+
+
+std::string DirEntry::atName() const
+{
+    return parent ? entryPath.filename().string() : entryPath.string();
+}
+
+
+FileType DirEntry::type(bool followSymlinks) const
+{
+    if (followSymlinks && (entryType == FileType::SYMLINK))
+    {
+#ifdef _WIN32
+        return getFileType(entryPath, true);
+#else
+        struct stat st;
+        if (::fstatat(atFd(), atName().c_str(), &st, 0) == -1)
+        {
+            return FileType::SYMLINK;
+        }
+        return getFileTypeFromMode(st.st_mode);
+#endif
+    }
+    return entryType;
+}
+
+
+StatInfo DirEntry::getStat() const
+{
+#ifdef _WIN32
+    return ut1::getStat(std::filesystem::directory_entry(entryPath));
+#else
+    StatInfo info;
+    if (::fstatat(atFd(), atName().c_str(), &info.statData, 0) == -1)
+    {
+        throw std::runtime_error(std::format("Cannot stat {}: {}.", entryPath.string(), std::strerror(errno)));
+    }
+    return info;
+#endif
+}
+
+
+std::vector<DirEntry> DirEntry::readDirectory() const
+{
+    std::vector<DirEntry> entries;
+#ifdef _WIN32
+    for (const std::filesystem::directory_entry& entry: std::filesystem::directory_iterator(entryPath))
+    {
+        entries.emplace_back(nullptr, entry.path(), getFileType(entry, false));
+    }
+#else
+    int fd = ::openat(atFd(), atName().c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        throw std::system_error(errno, std::generic_category(), std::format("Cannot open directory {}", entryPath.string()));
+    }
+    std::shared_ptr<const DirFd> dirFd = std::make_shared<const DirFd>(fd);
+    auto addEntry = [&](const char* name, unsigned char dType)
+    {
+        if (!isDotOrDotDot(name))
+        {
+            entries.emplace_back(dirFd, entryPath / name, getFileTypeFromDType(dType, fd, name));
+        }
+    };
+#ifdef __linux__
+    // Kernel struct linux_dirent64.
+    struct Dirent64
+    {
+        uint64_t       d_ino;
+        int64_t        d_off;
+        unsigned short d_reclen;
+        unsigned char  d_type;
+        char           d_name[1];
+    };
+
+    // Read many entries per syscall.
+    static constexpr size_t kBufferSize = 64 * 1024;
+    std::vector<char>       buffer(kBufferSize);
+    while (true)
+    {
+        long numBytes = ::syscall(SYS_getdents64, fd, buffer.data(), buffer.size());
+        if (numBytes == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throw std::runtime_error(std::format("Cannot read directory {}: {}.", entryPath.string(), std::strerror(errno)));
+        }
+        if (numBytes == 0)
+        {
+            break;
+        }
+        for (long pos = 0; pos < numBytes;)
+        {
+            const Dirent64* dirent = reinterpret_cast<const Dirent64*>(buffer.data() + pos);
+            pos += dirent->d_reclen;
+            addEntry(dirent->d_name, dirent->d_type);
+        }
+    }
+#else
+    // readdir() on a duplicate, so dirFd stays open for the entries.
+    int  dupFd = ::dup(fd);
+    DIR* dir   = (dupFd == -1) ? nullptr : ::fdopendir(dupFd);
+    if (dir == nullptr)
+    {
+        if (dupFd != -1)
+        {
+            ::close(dupFd);
+        }
+        throw std::runtime_error(std::format("Cannot read directory {}: {}.", entryPath.string(), std::strerror(errno)));
+    }
+    while (const struct dirent* dirent = ::readdir(dir))
+    {
+        addEntry(dirent->d_name, dirent->d_type);
+    }
+    ::closedir(dir);
+#endif
+#endif
+    return entries;
+}
+
+
+MappedFile DirEntry::map() const
+{
+#ifdef _WIN32
+    return MappedFile(entryPath.string());
+#else
+    return MappedFile(atFd(), atName());
+#endif
+}
+
+
+void DirEntry::writeFile(std::string_view data) const
+{
+#ifdef _WIN32
+    ut1::writeFile(entryPath.string(), data);
+#else
+    writeFileAt(atFd(), atName(), data);
+#endif
+}
+
+
+void DirEntry::rename(const std::string& newName)
+{
+    std::filesystem::path newPath = entryPath;
+    newPath.replace_filename(newName);
+#ifdef _WIN32
+    std::filesystem::rename(entryPath, newPath);
+#else
+    std::string newAtName = parent ? newName : newPath.string();
+    if (::renameat(atFd(), atName().c_str(), atFd(), newAtName.c_str()) == -1)
+    {
+        throw std::runtime_error(std::format("Cannot rename {} to {}: {}.", entryPath.string(), newPath.string(), std::strerror(errno)));
+    }
+#endif
+    entryPath = std::move(newPath);
+}
+
+
+DirEntry DirEntry::getSibling(const std::string& name) const
+{
+    std::filesystem::path siblingPath = entryPath;
+    siblingPath.replace_filename(name);
+#ifdef _WIN32
+    return DirEntry(nullptr, siblingPath, getFileType(siblingPath, false));
+#else
+    DirEntry    sibling(parent, siblingPath, FileType::NON_EXISTING);
+    struct stat st;
+    if (::fstatat(sibling.atFd(), sibling.atName().c_str(), &st, AT_SYMLINK_NOFOLLOW) == 0)
+    {
+        sibling.entryType = getFileTypeFromMode(st.st_mode);
+    }
+    return sibling;
+#endif
+}
+
+
+CopyMethod DirEntry::copyFile(const DirEntry& target) const
+{
+#ifdef _WIN32
+    std::filesystem::copy_file(entryPath, target.entryPath);
+    return CopyMethod::READ_WRITE;
+#else
+    return copyFileAt(atFd(), atName(), target.atFd(), target.atName());
+#endif
+}
+
+
+std::string DirEntry::readSymlink() const
+{
+#ifdef _WIN32
+    return std::filesystem::read_symlink(entryPath).string();
+#else
+    std::string target(256, 0);
+    while (true)
+    {
+        ssize_t n = ::readlinkat(atFd(), atName().c_str(), target.data(), target.size());
+        if (n == -1)
+        {
+            throw std::runtime_error(std::format("Cannot read symlink {}: {}.", entryPath.string(), std::strerror(errno)));
+        }
+        if (size_t(n) < target.size())
+        {
+            target.resize(size_t(n));
+            return target;
+        }
+        target.resize(target.size() * 2);
+    }
+#endif
+}
+
+
+void DirEntry::replaceSymlink(const std::string& target) const
+{
+#ifdef _WIN32
+    std::filesystem::remove(entryPath);
+    std::filesystem::create_symlink(target, entryPath);
+#else
+    if (::unlinkat(atFd(), atName().c_str(), 0) == -1)
+    {
+        throw std::runtime_error(std::format("Cannot remove symlink {}: {}.", entryPath.string(), std::strerror(errno)));
+    }
+    if (::symlinkat(target.c_str(), atFd(), atName().c_str()) == -1)
+    {
+        throw std::runtime_error(std::format("Cannot create symlink {}: {}.", entryPath.string(), std::strerror(errno)));
+    }
+#endif
+}
+
+
+UNIT_TEST(DirEntry)
+{
+    std::filesystem::path dir = "DirEntryTmp";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir / "sub");
+    writeFile((dir / "file").string(), "x");
+    std::filesystem::create_symlink("file", dir / "link");
+    std::filesystem::create_symlink("missing", dir / "dangling");
+
+    std::vector<DirEntry> entries = DirEntry(dir).readDirectory();
+    std::sort(entries.begin(), entries.end(), [](const DirEntry& a, const DirEntry& b) { return a.path() < b.path(); });
+    ASSERT_EQ(entries.size(), size_t(4));
+    ASSERT_EQ(entries[0].path(), dir / "dangling");
+    ASSERT_EQ(int(entries[0].type()), int(FileType::SYMLINK));
+    ASSERT_EQ(int(entries[0].type(true)), int(FileType::SYMLINK));
+    ASSERT_EQ(int(entries[1].type()), int(FileType::REGULAR));
+    ASSERT_EQ(int(entries[2].type()), int(FileType::SYMLINK));
+    ASSERT_EQ(int(entries[2].type(true)), int(FileType::REGULAR));
+    ASSERT_EQ(entries[3].path(), dir / "sub");
+    ASSERT_EQ(int(entries[3].type()), int(FileType::DIR));
+    ASSERT_EQ(int(DirEntry(dir / "sub").type()), int(FileType::DIR));
+
+    // Operations relative to the directory, also after the directory itself was renamed.
+    std::filesystem::rename(dir, "DirEntryTmp2");
+    dir = "DirEntryTmp2";
+    entries[1].writeFile("abc");
+    ASSERT_EQ(entries[1].map().view(), "abc");
+    entries[1].rename("file2");
+    ASSERT_EQ(entries[1].path().filename().string(), std::string("file2"));
+    ASSERT_EQ(readFile((dir / "file2").string()), "abc");
+    ASSERT_EQ(entries[2].readSymlink(), std::string("file"));
+    DirEntry copy = entries[1].getSibling("file3");
+    ASSERT_EQ(int(copy.type()), int(FileType::NON_EXISTING));
+    entries[1].copyFile(copy);
+    ASSERT_EQ(readFile((dir / "file3").string()), "abc");
+    ASSERT_EQ(int(entries[1].getSibling("file3").type()), int(FileType::REGULAR));
+    // Paths are not updated by renaming the directory (they are only used for messages).
+    ASSERT_EQ(entries[1].getSibling("file3").path(), entries[1].path().parent_path() / "file3");
+    entries[2].replaceSymlink("file2");
+    ASSERT_EQ(std::filesystem::read_symlink(dir / "link").string(), std::string("file2"));
+    ASSERT_EQ(int(entries[2].type(true)), int(FileType::REGULAR));
+
+    // Errors carry errno (streplace retries on EMFILE).
+    std::error_code error;
+    try
+    {
+        DirEntry(dir / "file2").readDirectory();
+    }
+    catch (const std::system_error& e)
+    {
+        error = e.code();
+    }
+    ASSERT_EQ(bool(error), true);
+#ifndef _WIN32
+    ASSERT_EQ(error == std::errc::not_a_directory, true);
+    error.clear();
+    try
+    {
+        DirEntry(dir / "missing").map();
+    }
+    catch (const std::system_error& e)
+    {
+        error = e.code();
+    }
+    ASSERT_EQ(error == std::errc::no_such_file_or_directory, true);
+#endif
+    std::filesystem::remove_all(dir);
+}
+
+} // namespace ut1
@@ -0,0 +1,114 @@
+// Directory traversal with file types from readdir() and directory-relative file operations.
+//
+// Copyright (c) 2026 Johannes Overmann
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "MiscUtils.hpp"
+
+namespace ut1
+{
+
+/// Open directory file descriptor, shared by all entries read from the directory.
+class DirFd
+{
+public:
+    explicit DirFd(int fd_) noexcept
+    : fd(fd_)
+    {
+    }
+
+    ~DirFd();
+
+    DirFd(const DirFd&)            = delete;
+    DirFd& operator=(const DirFd&) = delete;
+
+    /// Get file descriptor.
+    int get() const noexcept { return fd; }
+
+private:
+    int fd;
+};
+
+
+/// Directory entry with the file type cached when the entry is read.
+///
+/// Unlike std::filesystem::directory_entry this never calls stat() for type
+/// queries, except to follow symlinks.
+///
+/// Entries read from a directory keep the directory open and all file
+/// operations are relative to it (openat(), renameat(), ...), so the kernel
+/// does not resolve the whole path again for each operation and renaming
+/// parent directories does not affect the entry. path() is only used for
+/// messages then.
+class DirEntry
+{
+public:
+    /// Create entry for path (relative to the current directory), determining the type using lstat().
+    explicit DirEntry(const std::filesystem::path& path_);
+
+    /// Create entry for path in directory parent (nullptr: path is relative to the current directory).
+    DirEntry(std::shared_ptr<const DirFd> parent_, std::filesystem::path path_, FileType type_)
+    : parent(std::move(parent_))
+    , entryPath(std::move(path_))
+    , entryType(type_)
+    {
+    }
+
+    /// Get path.
+    const std::filesystem::path& path() const noexcept { return entryPath; }
+
+    /// Get file type (of the entry itself, symlinks are not followed).
+    FileType type() const noexcept { return entryType; }
+
+    /// Get file type. Symlinks are followed if followSymlinks is true (dangling symlinks are reported as SYMLINK, like getFileType()).
+    FileType type(bool followSymlinks) const;
+
+    /// Get stat() info (symlinks are followed). Throw std::runtime_error on errors.
+    StatInfo getStat() const;
+
+    /// Read all entries of this directory (except "." and "..").
+    /// On Linux this uses getdents64() with a large buffer and the d_type of each entry. Only entries with DT_UNKNOWN are stat()ed (using fstatat()).
+    /// Throw std::runtime_error on errors (std::system_error with errno if the directory cannot be opened).
+    std::vector<DirEntry> readDirectory() const;
+
+    /// Map/read file contents.
+    MappedFile map() const;
+
+    /// Overwrite file contents.
+    void writeFile(std::string_view data) const;
+
+    /// Rename entry within its directory.
+    void rename(const std::string& newName);
+
+    /// Get entry for name in the same directory (the type is determined using lstat()).
+    DirEntry getSibling(const std::string& name) const;
+
+    /// Copy file to the new file target with the same mode (see copyFileAt()).
+    CopyMethod copyFile(const DirEntry& target) const;
+
+    /// Get symlink target.
+    std::string readSymlink() const;
+
+    /// Replace symlink by a symlink to target.
+    void replaceSymlink(const std::string& target) const;
+
+    /// Get directory file descriptor and name for *at() calls (AT_FDCWD and the path for entries without parent).
+    int         atFd() const noexcept;
+    std::string atName() const;
+
+private:
+    std::shared_ptr<const DirFd> parent;
+    std::filesystem::path        entryPath;
+    FileType                     entryType;
+};
+
+} // namespace ut1
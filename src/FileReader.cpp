@@ -0,0 +1,762 @@
+// Batched and asynchronous reading of many files (io_uring or POSIX).
+//
+// Copyright (c) 2026 Johannes Overmann
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define UT1_HAVE_IO_URING 1
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+#include "FileReader.hpp"
+#include "UnitTest.hpp"
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <format>
+#include <unordered_map>
+
+#ifdef UT1_HAVE_IO_URING
+// Syscall numbers (identical on all architectures), for old C libraries.
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup 425
+#endif
+#ifndef __NR_io_uring_enter
+#define __NR_io_uring_enter 426
+#endif
+#ifndef __NR_io_uring_register
+#define __NR_io_uring_register 427
+#endif
+#endif
+
+namespace ut1
+{
+
+const char* getIoEngineName(IoEngine engine)
+{
+    return (engine == IoEngine::IO_URING) ? "io_uring" : "posix";
+}
+
+
+/// POSIX reader: Reads one file per wait() call using DirEntry::map().
+class PosixFileReader: public FileReader
+{
+public:
+    void add(const DirEntry& entry, size_t id) override { files.emplace_back(entry, id); }
+
+    size_t getNumPending() const noexcept override { return files.size(); }
+
+    std::vector<Result> wait() override
+    {
+        std::vector<Result> results;
+        if (files.empty())
+        {
+            return results;
+        }
+        Result& result = results.emplace_back();
+        result.id      = files.front().second;
+        try
+        {
+            result.file = files.front().first.map();
+            result.file.prefault();
+        }
+        catch (...)
+        {
+            result.error = std::current_exception();
+        }
+        files.pop_front();
+        return results;
+    }
+
+private:
+    std::deque<std::pair<DirEntry, size_t>> files;
+};
+
+
+#ifdef UT1_HAVE_IO_URING
+/// Minimal io_uring wrapper using the raw syscalls (no liburing).
+class IoUring
+{
+public:
+    /// Set up ring with at least numEntries submission queue entries. Throw std::runtime_error on errors.
+    explicit IoUring(unsigned numEntries)
+    {
+        io_uring_params params{};
+        fd = int(::syscall(__NR_io_uring_setup, numEntries, &params));
+        if (fd < 0)
+        {
+            throw std::runtime_error(std::format("io_uring_setup(): {}.", std::strerror(errno)));
+        }
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        sqesSize   = params.sq_entries * sizeof(io_uring_sqe);
+        bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (singleMmap)
+        {
+            sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+        }
+        sqRing = mapRing(sqRingSize, IORING_OFF_SQ_RING);
+        cqRing = singleMmap ? sqRing : mapRing(cqRingSize, IORING_OFF_CQ_RING);
+        sqes   = static_cast<io_uring_sqe*>(mapRing(sqesSize, IORING_OFF_SQES));
+
+        char* sq      = static_cast<char*>(sqRing);
+        char* cq      = static_cast<char*>(cqRing);
+        sqHead        = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sqTail        = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask        = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray       = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        sqEntries     = params.sq_entries;
+        cqHead        = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail        = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask        = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes          = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        localSqTail   = *sqTail;
+        submittedTail = localSqTail;
+    }
+
+    ~IoUring() { release(); }
+
+    IoUring(const IoUring&)            = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    /// Return true iff all opcodes are supported by the kernel.
+    bool supportsOpcodes(std::initializer_list<unsigned> opcodes) const
+    {
+        static constexpr unsigned kNumOps = 256;
+        std::vector<char>         buffer(sizeof(io_uring_probe) + kNumOps * sizeof(io_uring_probe_op));
+        io_uring_probe*           probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+        if (::syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, kNumOps) < 0)
+        {
+            return false;
+        }
+        for (unsigned opcode: opcodes)
+        {
+            if ((opcode > probe->last_op) || !(probe->ops[opcode].flags & IO_URING_OP_SUPPORTED))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /// Get zeroed submission queue entry. Submit queued entries first if the queue is full.
+    io_uring_sqe& getSqe()
+    {
+        while (localSqTail - std::atomic_ref<unsigned>(*sqHead).load(std::memory_order_acquire) >= sqEntries)
+        {
+            submitAndWait(0);
+        }
+        unsigned      index = localSqTail & sqMask;
+        io_uring_sqe& sqe   = sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqArray[index] = index;
+        localSqTail++;
+        return sqe;
+    }
+
+    /// Submit all queued entries and wait for at least minComplete completions (single io_uring_enter() syscall).
+    void submitAndWait(unsigned minComplete)
+    {
+        std::atomic_ref<unsigned>(*sqTail).store(localSqTail, std::memory_order_release);
+        while (true)
+        {
+            unsigned toSubmit = localSqTail - submittedTail;
+            if ((toSubmit == 0) && (minComplete == 0))
+            {
+                return;
+            }
+            int r = int(::syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, minComplete ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+            if (r < 0)
+            {
+                if ((errno == EINTR) || (errno == EAGAIN) || (errno == EBUSY))
+                {
+                    continue;
+                }
+                throw std::runtime_error(std::format("io_uring_enter(): {}.", std::strerror(errno)));
+            }
+            submittedTail += unsigned(r);
+            if (submittedTail == localSqTail)
+            {
+                return;
+            }
+        }
+    }
+
+    /// Call f(cqe) for each available completion.
+    template<class F>
+    void forEachCqe(F f)
+    {
+        unsigned head = *cqHead;
+        unsigned tail = std::atomic_ref<unsigned>(*cqTail).load(std::memory_order_acquire);
+        for (; head != tail; head++)
+        {
+            io_uring_cqe cqe = cqes[head & cqMask];
+            std::atomic_ref<unsigned>(*cqHead).store(head + 1, std::memory_order_release);
+            f(cqe);
+        }
+    }
+
+private:
+    /// Map part of the ring. Release everything and throw std::runtime_error on errors.
+    void* mapRing(size_t size, off_t offset)
+    {
+        void* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+        if (p == MAP_FAILED)
+        {
+            const std::string error = std::strerror(errno);
+            release();
+            throw std::runtime_error(std::format("io_uring mmap(): {}.", error));
+        }
+        return p;
+    }
+
+    /// Unmap rings and close ring fd.
+    void release() noexcept
+    {
+        if (sqes)
+        {
+            ::munmap(sqes, sqesSize);
+        }
+        if (cqRing && (cqRing != sqRing))
+        {
+            ::munmap(cqRing, cqRingSize);
+        }
+        if (sqRing)
+        {
+            ::munmap(sqRing, sqRingSize);
+        }
+        ::close(fd);
+    }
+
+    int           fd{-1};
+    void*         sqRing{};
+    void*         cqRing{};
+    io_uring_sqe* sqes{};
+    size_t        sqRingSize{};
+    size_t        cqRingSize{};
+    size_t        sqesSize{};
+    unsigned*     sqHead{};
+    unsigned*     sqTail{};
+    unsigned      sqMask{};
+    unsigned*     sqArray{};
+    unsigned      sqEntries{};
+    unsigned*     cqHead{};
+    unsigned*     cqTail{};
+    unsigned      cqMask{};
+    io_uring_cqe* cqes{};
+    unsigned      localSqTail{};
+    unsigned      submittedTail{};
+};
+
+
+/// io_uring reader: Each file is opened and statx()ed in parallel, then read into a buffer and closed.
+/// The operations of all pending files are submitted and completed together in one io_uring_enter() call per round.
+/// Files larger than kMaxReadSize (and non-regular files) are mapped using DirEntry::map() instead.
+class IoUringFileReader: public FileReader
+{
+public:
+    IoUringFileReader()
+    : ring(kRingSize)
+    {
+    }
+
+    ~IoUringFileReader() override
+    {
+        // Wait for all operations (the kernel may still write into the buffers), then close the files which are still open.
+        try
+        {
+            while (numOps > 0)
+            {
+                ring.submitAndWait(1);
+                ring.forEachCqe([this](const io_uring_cqe& cqe)
+                    {
+                        numOps--;
+                        if (((cqe.user_data & kOpMask) == OP_OPEN) && (cqe.res >= 0))
+                        {
+                            ::close(cqe.res);
+                        }
+                    });
+            }
+        }
+        catch (const std::exception&)
+        {
+        }
+        for (std::unique_ptr<Request>& request: requests)
+        {
+            if (request && (request->fd >= 0))
+            {
+                ::close(request->fd);
+            }
+        }
+    }
+
+    /// Return true iff io_uring and all used operations are supported.
+    static bool isSupported()
+    {
+        try
+        {
+            IoUring ring(2);
+            return ring.supportsOpcodes({IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_CLOSE});
+        }
+        catch (const std::exception&)
+        {
+            return false;
+        }
+    }
+
+    void add(const DirEntry& entry, size_t id) override
+    {
+        std::unique_ptr<Request> request = std::make_unique<Request>(entry, id);
+        request->name                    = entry.atName();
+        waiting.push_back(std::move(request));
+    }
+
+    size_t getNumPending() const noexcept override { return waiting.size() + numInFlight; }
+
+    std::vector<Result> wait() override
+    {
+        std::vector<Result> results;
+        while (results.empty() && (getNumPending() > 0))
+        {
+            startWaitingRequests();
+            ring.submitAndWait(1);
+            ring.forEachCqe([&](const io_uring_cqe& cqe) { complete(cqe, results); });
+        }
+        // Do not leave close operations unsubmitted.
+        ring.submitAndWait(0);
+        return results;
+    }
+
+private:
+    /// Operations (low bits of user_data, the high bits are the request index).
+    enum Op : uint64_t { OP_OPEN, OP_STATX, OP_READ, OP_CLOSE };
+    static constexpr uint64_t kOpBits = 2;
+    static constexpr uint64_t kOpMask = (1 << kOpBits) - 1;
+
+    static constexpr unsigned kRingSize     = 256;
+    static constexpr size_t   kMaxInFlight  = kRingSize / 4;
+    static constexpr size_t   kMaxReadSize  = 1024 * 1024;
+
+    struct Request
+    {
+        Request(const DirEntry& entry_, size_t id_)
+        : entry(entry_)
+        , id(id_)
+        {
+        }
+
+        DirEntry     entry;
+        size_t       id;
+        std::string  name;  ///< Kept alive while the kernel may access it.
+        int          fd{-1};
+        int          error{};
+        unsigned     numOps{};
+        struct statx stx{};
+        std::string  data;
+        size_t       offset{};
+    };
+
+    /// Start open and statx of waiting requests.
+    void startWaitingRequests()
+    {
+        while (!waiting.empty() && (numInFlight < kMaxInFlight))
+        {
+            size_t index;
+            if (freeIndices.empty())
+            {
+                index = requests.size();
+                requests.emplace_back();
+            }
+            else
+            {
+                index = freeIndices.back();
+                freeIndices.pop_back();
+            }
+            requests[index] = std::move(waiting.front());
+            waiting.pop_front();
+            numInFlight++;
+            Request& request = *requests[index];
+
+            io_uring_sqe& openSqe = ring.getSqe();
+            openSqe.opcode        = IORING_OP_OPENAT;
+            openSqe.fd            = request.entry.atFd();
+            openSqe.addr          = reinterpret_cast<uint64_t>(request.name.c_str());
+            openSqe.open_flags    = O_RDONLY | O_CLOEXEC;
+            openSqe.user_data     = (index << kOpBits) | OP_OPEN;
+
+            io_uring_sqe& statxSqe = ring.getSqe();
+            statxSqe.opcode        = IORING_OP_STATX;
+            statxSqe.fd            = request.entry.atFd();
+            statxSqe.addr          = reinterpret_cast<uint64_t>(request.name.c_str());
+            statxSqe.len           = STATX_TYPE | STATX_SIZE;
+            statxSqe.off           = reinterpret_cast<uint64_t>(&request.stx);
+            statxSqe.user_data     = (index << kOpBits) | OP_STATX;
+
+            request.numOps = 2;
+            numOps += 2;
+        }
+    }
+
+    /// Submit read of the rest of the buffer of request.
+    void submitRead(size_t index)
+    {
+        Request&      request = *requests[index];
+        io_uring_sqe& readSqe = ring.getSqe();
+        readSqe.opcode        = IORING_OP_READ;
+        readSqe.fd            = request.fd;
+        readSqe.addr          = reinterpret_cast<uint64_t>(request.data.data() + request.offset);
+        readSqe.len           = unsigned(request.data.size() - request.offset);
+        readSqe.off           = request.offset;
+        readSqe.user_data     = (index << kOpBits) | OP_READ;
+        request.numOps++;
+        numOps++;
+    }
+
+    /// Close fd asynchronously.
+    void submitClose(int fd)
+    {
+        io_uring_sqe& closeSqe = ring.getSqe();
+        closeSqe.opcode        = IORING_OP_CLOSE;
+        closeSqe.fd            = fd;
+        closeSqe.user_data     = OP_CLOSE;
+        numOps++;
+    }
+
+    /// Handle completion.
+    void complete(const io_uring_cqe& cqe, std::vector<Result>& results)
+    {
+        numOps--;
+        Op op = Op(cqe.user_data & kOpMask);
+        if (op == OP_CLOSE)
+        {
+            return;
+        }
+        size_t   index   = size_t(cqe.user_data >> kOpBits);
+        Request& request = *requests[index];
+        request.numOps--;
+        switch (op)
+        {
+        case OP_OPEN:
+            if (cqe.res >= 0)
+            {
+                request.fd = cqe.res;
+            }
+            else
+            {
+                request.error = -cqe.res;
+            }
+            break;
+
+        case OP_STATX:
+            // Open errors take precedence (they are more specific, e.g. for unreadable files).
+            if ((cqe.res < 0) && (request.error == 0))
+            {
+                request.error = -cqe.res;
+            }
+            break;
+
+        case OP_READ:
+            if (cqe.res < 0)
+            {
+                if ((cqe.res == -EINTR) || (cqe.res == -EAGAIN))
+                {
+                    submitRead(index);
+                    return;
+                }
+                request.error = -cqe.res;
+                break;
+            }
+            request.offset += size_t(cqe.res);
+            if ((cqe.res > 0) && (request.offset == request.data.size()))
+            {
+                // File is larger than reported by statx() (or a pseudo file with size 0).
+                request.data.resize(request.data.size() * 2);
+                submitRead(index);
+                return;
+            }
+            if ((cqe.res > 0) && (request.offset < request.stx.stx_size))
+            {
+                submitRead(index);
+                return;
+            }
+            break;
+
+        case OP_CLOSE:
+            break;
+        }
+        if (request.numOps > 0)
+        {
+            return;
+        }
+
+        if ((op == OP_OPEN) || (op == OP_STATX))
+        {
+            // Open and statx done.
+            if ((request.error == 0) && S_ISREG(request.stx.stx_mode) && (request.stx.stx_size <= kMaxReadSize))
+            {
+                // Read one byte more than the size to see the end of file in the same read.
+                request.data.resize(size_t(request.stx.stx_size) + 1);
+                submitRead(index);
+                return;
+            }
+        }
+        finish(index, results);
+    }
+
+    /// Close file and return result of request.
+    void finish(size_t index, std::vector<Result>& results)
+    {
+        std::unique_ptr<Request> request = std::move(requests[index]);
+        freeIndices.push_back(index);
+        numInFlight--;
+        if (request->fd >= 0)
+        {
+            submitClose(request->fd);
+        }
+
+        Result& result = results.emplace_back();
+        result.id      = request->id;
+        try
+        {
+            if (request->error)
+            {
+                throw std::runtime_error(std::format("MappedFile({}): Error while opening file for reading: {}.", request->name, std::strerror(request->error)));
+            }
+            if (request->data.empty())
+            {
+                // Large or special file.
+                result.file = request->entry.map();
+                result.file.prefault();
+            }
+            else
+            {
+                request->data.resize(request->offset);
+                result.file = MappedFile::fromBuffer(std::move(request->data));
+            }
+        }
+        catch (...)
+        {
+            result.error = std::current_exception();
+        }
+    }
+
+    IoUring                               ring;
+    std::deque<std::unique_ptr<Request>>  waiting;
+    std::vector<std::unique_ptr<Request>> requests; ///< In flight, indexed by user_data (nullptr for free entries).
+    std::vector<size_t>                   freeIndices;
+    size_t                                numInFlight{};
+    unsigned                              numOps{}; ///< Submitted operations without completion.
+};
+#endif
+
+
+bool isIoUringSupported()
+{
+#ifdef UT1_HAVE_IO_URING
+    static const bool supported = IoUringFileReader::isSupported();
+    return supported;
+#else
+    return false;
+#endif
+}
+
+
+std::unique_ptr<FileReader> FileReader::create(IoEngine engine)
+{
+    if (engine == IoEngine::IO_URING)
+    {
+#ifdef UT1_HAVE_IO_URING
+        if (isIoUringSupported())
+        {
+            return std::make_unique<IoUringFileReader>();
+        }
+#endif
+        throw std::runtime_error("io_uring is not supported.");
+    }
+    return std::make_unique<PosixFileReader>();
+}
+
+
+AsyncFileReader::AsyncFileReader(IoEngine engine_, unsigned numThreads, std::function<void(const MappedFile&)> onRead_)
+: engine(engine_)
+, maxInFlight((engine_ == IoEngine::IO_URING) ? std::max(numThreads, 1u) * 16 : 1)
+, onRead(std::move(onRead_))
+{
+    if ((engine == IoEngine::IO_URING) && !isIoUringSupported())
+    {
+        throw std::runtime_error("io_uring is not supported.");
+    }
+    numThreads = (engine == IoEngine::IO_URING) ? 1 : std::max(numThreads, 1u);
+    for (unsigned i = 0; i < numThreads; i++)
+    {
+        threads.emplace_back([this]() { run(); });
+    }
+}
+
+
+AsyncFileReader::~AsyncFileReader()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    requestAvailable.notify_all();
+    for (std::thread& thread: threads)
+    {
+        thread.join();
+    }
+}
+
+
+std::future<MappedFile> AsyncFileReader::read(const DirEntry& entry)
+{
+    std::promise<MappedFile> promise;
+    std::future<MappedFile>  future = promise.get_future();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        requests.push_back({entry, std::move(promise)});
+    }
+    requestAvailable.notify_one();
+    return future;
+}
+
+
+void AsyncFileReader::run()
+{
+    std::unique_ptr<FileReader>                         reader = FileReader::create(engine);
+    std::unordered_map<size_t, std::promise<MappedFile>> inFlight;
+    size_t                                              nextId = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (inFlight.empty())
+            {
+                requestAvailable.wait(lock, [this]() { return stopping || !requests.empty(); });
+            }
+            if (stopping)
+            {
+                return;
+            }
+            while (!requests.empty() && (inFlight.size() < maxInFlight))
+            {
+                reader->add(requests.front().entry, nextId);
+                inFlight.emplace(nextId++, std::move(requests.front().promise));
+                requests.pop_front();
+            }
+        }
+
+        std::vector<FileReader::Result> results;
+        try
+        {
+            results = reader->wait();
+        }
+        catch (...)
+        {
+            // Engine failure: Fail all files in flight.
+            for (auto& [id, promise]: inFlight)
+            {
+                promise.set_exception(std::current_exception());
+            }
+            inFlight.clear();
+            reader = FileReader::create(engine);
+            continue;
+        }
+        for (FileReader::Result& result: results)
+        {
+            auto it = inFlight.find(result.id);
+            if (result.error)
+            {
+                it->second.set_exception(result.error);
+            }
+            else
+            {
+                if (onRead)
+                {
+                    onRead(result.file);
+                }
+                it->second.set_value(std::move(result.file));
+            }
+            inFlight.erase(it);
+        }
+    }
+}
+
+
+UNIT_TEST(FileReader)
+{
+    std::filesystem::path dir = "FileReaderTmp";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir / "sub");
+    std::string big(3 * 1024 * 1024 + 7, 'x');
+    writeFile((dir / "a").string(), "abc");
+    writeFile((dir / "empty").string(), "");
+    writeFile((dir / "big").string(), big);
+
+    std::vector<IoEngine> engines = {IoEngine::POSIX};
+    if (isIoUringSupported())
+    {
+        engines.push_back(IoEngine::IO_URING);
+    }
+    for (IoEngine engine: engines)
+    {
+        // Batch interface: Results in any order.
+        std::unique_ptr<FileReader> reader  = FileReader::create(engine);
+        std::vector<DirEntry>       entries = DirEntry(dir).readDirectory();
+        entries.push_back(DirEntry(dir / "missing"));
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            reader->add(entries[i], i);
+        }
+        ASSERT_EQ(reader->getNumPending(), size_t(5));
+        size_t numFiles  = 0;
+        size_t numErrors = 0;
+        while (reader->getNumPending() > 0)
+        {
+            for (FileReader::Result& result: reader->wait())
+            {
+                const std::string name = entries[result.id].path().filename().string();
+                if (result.error)
+                {
+                    // Missing file and directory (read() fails with EISDIR).
+                    ASSERT_EQ((name == "missing") || (name == "sub"), true);
+                    numErrors++;
+                    continue;
+                }
+                std::string expected = (name == "a") ? "abc" : ((name == "big") ? big : "");
+                ASSERT_EQ(result.file.view() == expected, true);
+                numFiles++;
+            }
+        }
+        ASSERT_EQ(numFiles, size_t(3));
+        ASSERT_EQ(numErrors, size_t(2));
+        ASSERT_EQ(reader->wait().size(), size_t(0));
+
+        // Asynchronous interface.
+        std::atomic<size_t> numBytes{};
+        AsyncFileReader     asyncReader(engine, 2, [&](const MappedFile& file) { numBytes += file.size(); });
+        std::future<MappedFile> a = asyncReader.read(DirEntry(dir / "a"));
+        std::future<MappedFile> m = asyncReader.read(DirEntry(dir / "missing"));
+        ASSERT_EQ(a.get().view(), "abc");
+        bool thrown = false;
+        try
+        {
+            m.get();
+        }
+        catch (const std::runtime_error&)
+        {
+            thrown = true;
+        }
+        ASSERT_EQ(thrown, true);
+        ASSERT_EQ(size_t(numBytes), size_t(3));
+    }
+    std::filesystem::remove_all(dir);
+}
+
+} // namespace ut1
@@ -0,0 +1,114 @@
+// Batched and asynchronous reading of many files (io_uring or POSIX).
+//
+// Copyright (c) 2026 Johannes Overmann
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "DirEntry.hpp"
+#include "MiscUtils.hpp"
+
+namespace ut1
+{
+
+/// I/O engine used to read files.
+enum class IoEngine
+{
+    POSIX,   ///< open()/fstat()/mmap() or read() per file.
+    IO_URING ///< Linux io_uring: open/statx/read/close of many files with few syscalls.
+};
+
+
+/// Return true iff the io_uring engine is supported by the running kernel (checked once).
+bool isIoUringSupported();
+
+/// Get name of engine ("posix" or "io_uring").
+const char* getIoEngineName(IoEngine engine);
+
+
+/// Batch file reader: Files are added, the completed files are returned in any order.
+/// Not thread-safe, each thread uses its own reader.
+class FileReader
+{
+public:
+    /// Read file.
+    struct Result
+    {
+        size_t             id{};
+        MappedFile         file;
+        std::exception_ptr error; ///< Set instead of file on errors.
+    };
+
+    /// Create reader for engine. Throw std::runtime_error if the engine is not supported.
+    static std::unique_ptr<FileReader> create(IoEngine engine);
+
+    virtual ~FileReader() = default;
+
+    /// Add file to be read. id is returned in the result.
+    virtual void add(const DirEntry& entry, size_t id) = 0;
+
+    /// Get number of added files which are not returned by wait() yet.
+    virtual size_t getNumPending() const noexcept = 0;
+
+    /// Wait until at least one file is read and return all read files (nothing if no file is pending).
+    virtual std::vector<Result> wait() = 0;
+};
+
+
+/// Asynchronous file reader: Reads files in background threads using a FileReader.
+///
+/// POSIX uses numThreads threads, each reading one file at a time.
+/// io_uring uses a single thread which keeps up to numThreads * 16 files in flight.
+class AsyncFileReader
+{
+public:
+    /// Constructor. onRead() is called in a reader thread for each successfully read file before its future becomes ready.
+    AsyncFileReader(IoEngine engine_, unsigned numThreads, std::function<void(const MappedFile&)> onRead_ = {});
+
+    /// Destructor. Files which are not read yet are dropped (their futures report broken_promise).
+    ~AsyncFileReader();
+
+    AsyncFileReader(const AsyncFileReader&)            = delete;
+    AsyncFileReader& operator=(const AsyncFileReader&) = delete;
+
+    /// Read file in the background.
+    std::future<MappedFile> read(const DirEntry& entry);
+
+    /// Get engine.
+    IoEngine getEngine() const noexcept { return engine; }
+
+private:
+    struct Request
+    {
+        DirEntry                 entry;
+        std::promise<MappedFile> promise;
+    };
+
+    /// Reader thread.
+    void run();
+
+    IoEngine                                engine;
+    size_t                                  maxInFlight;
+    std::function<void(const MappedFile&)> onRead;
+
+    std::mutex              mutex;
+    std::condition_variable requestAvailable;
+    std::deque<Request>     requests;
+    bool                    stopping{};
+
+    std::vector<std::thread> threads;
+};
+
+} // namespace ut1
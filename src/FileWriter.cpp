@@ -0,0 +1,420 @@
+// Writing modified files in place or atomically, with batched syncing.
+//
+// Copyright (c) 2026 Johannes Overmann
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+#include "FileWriter.hpp"
+#include "UnitTest.hpp"
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <format>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <set>
+
+namespace ut1
+{
+
+#ifndef _WIN32
+/// Open the directory containing entry. Throw std::runtime_error on errors.
+static std::unique_ptr<DirFd> openParentDirectory(const DirEntry& entry)
+{
+    std::string name  = entry.atName();
+    size_t      slash = name.rfind('/');
+    std::string dir   = (slash == std::string::npos) ? std::string(".") : name.substr(0, slash + 1);
+    int         fd    = ::openat(entry.atFd(), dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        throw std::runtime_error(std::format("Cannot open directory of {}: {}.", entry.path().string(), std::strerror(errno)));
+    }
+    return std::make_unique<DirFd>(fd);
+}
+
+
+/// Sync directory, so renames in it are durable. Throw std::runtime_error on errors.
+static void syncDirectory(const DirFd& dir, const DirEntry& entry)
+{
+    if (::fsync(dir.get()) == -1)
+    {
+        throw std::runtime_error(std::format("Cannot sync directory of {}: {}.", entry.path().string(), std::strerror(errno)));
+    }
+}
+#endif
+
+
+FileWriter::~FileWriter()
+{
+    try
+    {
+        flush();
+    }
+    catch (const std::exception&)
+    {
+    }
+}
+
+
+void FileWriter::write(const DirEntry& entry, std::string_view data)
+{
+#ifdef _WIN32
+    // No atomic replacement and no syncing.
+    entry.writeFile(data);
+#else
+    bool        syncEach = syncBatchSize == 1;
+    std::string tempName;
+    if (atomic)
+    {
+        tempName = writeTempFileAt(entry.atFd(), entry.atName(), data, syncEach);
+    }
+    if (tempName.empty())
+    {
+        writeFileAt(entry.atFd(), entry.atName(), data, syncEach);
+    }
+
+    if (tempName.empty())
+    {
+        syncInPlace(entry);
+        return;
+    }
+    replaceLater(entry, std::move(tempName));
+#endif
+}
+
+
+void FileWriter::replace([[maybe_unused]] const DirEntry& entry, TempFile& temp)
+{
+#ifdef _WIN32
+    // Throws: Temporary files are never open on Windows.
+    temp.commit(false);
+#else
+    replaceLater(entry, temp.commit(syncBatchSize == 1));
+#endif
+}
+
+
+#ifndef _WIN32
+void FileWriter::replaceLater(const DirEntry& entry, std::string tempName)
+{
+    bool syncEach = syncBatchSize == 1;
+    if (syncBatchSize <= 1)
+    {
+        replaceFileAt(entry.atFd(), tempName, entry.atName());
+        if (syncEach)
+        {
+            syncDirectory(*openParentDirectory(entry), entry);
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    pending.push_back({entry, std::move(tempName)});
+    if (pending.size() >= syncBatchSize)
+    {
+        flushLocked();
+    }
+}
+#endif
+
+
+std::vector<FileWriter::Change> FileWriter::getChanges(std::string_view oldData, std::string_view newData)
+{
+    std::vector<Change> changes;
+    static constexpr size_t kBlockSize = 4096;
+    size_t                  size       = std::min(oldData.size(), newData.size());
+    size_t                  pos        = 0;
+    while (pos < size)
+    {
+        // Skip unchanged blocks quickly.
+        size_t len = std::min(kBlockSize, size - pos);
+        if (std::memcmp(oldData.data() + pos, newData.data() + pos, len) == 0)
+        {
+            pos += len;
+            continue;
+        }
+        while (oldData[pos] == newData[pos])
+        {
+            pos++;
+        }
+
+        // The change ends before kMinUnchanged unchanged bytes (or at the end).
+        size_t begin = pos;
+        size_t end   = pos + 1;
+        for (pos = end; (pos < size) && (pos - end < kMinUnchanged); pos++)
+        {
+            if (oldData[pos] != newData[pos])
+            {
+                end = pos + 1;
+            }
+        }
+        changes.push_back({begin, std::string(newData.substr(begin, end - begin))});
+        pos = end;
+    }
+    return changes;
+}
+
+
+void FileWriter::writeChanges(const DirEntry& entry, const std::vector<Change>& changes)
+{
+#ifdef _WIN32
+    std::fstream os(entry.path(), std::ios::in | std::ios::out | std::ios::binary);
+    for (const Change& change: changes)
+    {
+        os.seekp(std::streamoff(change.offset));
+        os.write(change.data.data(), std::streamsize(change.data.size()));
+    }
+    if (!os)
+    {
+        throw std::runtime_error(std::format("writeFile({}): Error while writing file.", entry.path().string()));
+    }
+#else
+    const std::string name = entry.atName();
+    int               fd   = ::openat(entry.atFd(), name.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        throw std::runtime_error(std::format("writeFile({}): Error while opening file for writing: {}.", name, std::strerror(errno)));
+    }
+    for (const Change& change: changes)
+    {
+        for (size_t pos = 0; pos < change.data.size();)
+        {
+            ssize_t n = ::pwrite(fd, change.data.data() + pos, change.data.size() - pos, off_t(change.offset + pos));
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                const std::string error = std::strerror(errno);
+                ::close(fd);
+                throw std::runtime_error(std::format("writeFile({}): Error while writing file: {}.", name, error));
+            }
+            pos += size_t(n);
+        }
+    }
+    if ((syncBatchSize == 1) && (::fsync(fd) == -1))
+    {
+        const std::string error = std::strerror(errno);
+        ::close(fd);
+        throw std::runtime_error(std::format("writeFile({}): Error while syncing file: {}.", name, error));
+    }
+    if (::close(fd) == -1)
+    {
+        throw std::runtime_error(std::format("writeFile({}): Error while closing file: {}.", name, std::strerror(errno)));
+    }
+    syncInPlace(entry);
+#endif
+}
+
+
+void FileWriter::syncInPlace(const DirEntry& entry)
+{
+    // Files written in place are synced by writeFileAt() for syncBatchSize 1 and take part in the syncfs() of their batch otherwise.
+    if (syncBatchSize > 1)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.push_back({entry, std::string()});
+        if (pending.size() >= syncBatchSize)
+        {
+            flushLocked();
+        }
+    }
+}
+
+
+void FileWriter::flush()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    flushLocked();
+}
+
+
+void FileWriter::flushLocked()
+{
+#ifndef _WIN32
+    if (pending.empty())
+    {
+        return;
+    }
+    std::vector<PendingFile> files = std::move(pending);
+    pending.clear();
+    std::exception_ptr firstError;
+    auto               recordError = [&](std::exception_ptr error)
+    {
+        if (!firstError)
+        {
+            firstError = error;
+        }
+    };
+
+    // Open each directory once.
+    std::map<std::pair<int, std::string>, std::unique_ptr<DirFd>> dirs;
+    std::vector<DirFd*>                                            fileDirs;
+    for (const PendingFile& file: files)
+    {
+        std::string name  = file.entry.atName();
+        size_t      slash = name.rfind('/');
+        auto        key   = std::make_pair(file.entry.atFd(), (slash == std::string::npos) ? std::string() : name.substr(0, slash));
+        auto        it    = dirs.find(key);
+        if (it == dirs.end())
+        {
+            std::unique_ptr<DirFd> dir;
+            try
+            {
+                dir = openParentDirectory(file.entry);
+            }
+            catch (const std::exception&)
+            {
+                recordError(std::current_exception());
+            }
+            it = dirs.emplace(key, std::move(dir)).first;
+        }
+        fileDirs.push_back(it->second.get());
+    }
+
+    // Sync each filesystem once.
+#ifdef __linux__
+    std::set<dev_t> synced;
+    for (const auto& [key, dir]: dirs)
+    {
+        struct stat st;
+        if (dir && (::fstat(dir->get(), &st) == 0) && synced.insert(st.st_dev).second && (::syncfs(dir->get()) == -1))
+        {
+            recordError(std::make_exception_ptr(std::runtime_error(std::format("Cannot sync filesystem: {}.", std::strerror(errno)))));
+        }
+    }
+#else
+    ::sync();
+#endif
+
+    // Replace the originals by the synced files, then make the renames durable.
+    std::set<DirFd*> renamedDirs;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        const PendingFile& file = files[i];
+        if (file.tempName.empty())
+        {
+            continue;
+        }
+        try
+        {
+            replaceFileAt(file.entry.atFd(), file.tempName, file.entry.atName());
+            if (fileDirs[i] && renamedDirs.insert(fileDirs[i]).second)
+            {
+                syncDirectory(*fileDirs[i], file.entry);
+            }
+        }
+        catch (const std::exception&)
+        {
+            recordError(std::current_exception());
+        }
+    }
+    if (firstError)
+    {
+        std::rethrow_exception(firstError);
+    }
+#endif
+}
+
+
+UNIT_TEST(FileWriter)
+{
+    std::filesystem::path dir = "FileWriterTmp";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    for (int i = 0; i < 5; i++)
+    {
+        writeFile((dir / std::format("f{}", i)).string(), "old");
+    }
+    std::filesystem::create_symlink("f0", dir / "link");
+
+    for (bool atomic: {false, true})
+    {
+        for (unsigned syncBatchSize: {0u, 1u, 3u})
+        {
+            std::string data = std::format("{}{}", atomic, syncBatchSize);
+            {
+                FileWriter            writer(atomic, syncBatchSize);
+                std::vector<DirEntry> entries = DirEntry(dir).readDirectory();
+                for (const DirEntry& entry: entries)
+                {
+                    if (entry.type() == FileType::REGULAR)
+                    {
+                        writer.write(entry, data);
+                    }
+                }
+                // The last batch is flushed by the destructor.
+                writer.write(DirEntry(dir / "link"), data);
+            }
+            for (int i = 0; i < 5; i++)
+            {
+                ASSERT_EQ(readFile((dir / std::format("f{}", i)).string()), data);
+            }
+            // The symlink is written through, not replaced.
+            ASSERT_EQ(int(DirEntry(dir / "link").type()), int(FileType::SYMLINK));
+        }
+    }
+
+    // Atomic replacements are deferred until the batch is synced.
+    {
+        FileWriter writer(true, 3);
+        writer.write(DirEntry(dir / "f0"), "new");
+        ASSERT_EQ(readFile((dir / "f0").string()), std::string("true3"));
+        writer.flush();
+        ASSERT_EQ(readFile((dir / "f0").string()), std::string("new"));
+    }
+
+#ifndef _WIN32
+    // Streamed temporary files are replaced like atomic writes (also without --atomic).
+    {
+        FileWriter writer(false, 3);
+        DirEntry   entry(dir / "f0");
+        TempFile   temp(entry.atFd(), entry.atName());
+        temp.write("stre");
+        temp.write("amed");
+        writer.replace(entry, temp);
+        ASSERT_EQ(readFile((dir / "f0").string()), std::string("new"));
+        writer.flush();
+        ASSERT_EQ(readFile((dir / "f0").string()), std::string("streamed"));
+    }
+#endif
+
+    // Changed ranges.
+    std::string oldData(10000, 'a');
+    std::string newData = oldData;
+    newData[5]          = 'b';
+    newData[5 + FileWriter::kMinUnchanged] = 'b';
+    newData[9999]       = 'c';
+    std::vector<FileWriter::Change> changes = FileWriter::getChanges(oldData, newData);
+    ASSERT_EQ(changes.size(), size_t(2));
+    ASSERT_EQ(changes[0].offset, size_t(5));
+    ASSERT_EQ(changes[0].data, "b" + std::string(FileWriter::kMinUnchanged - 1, 'a') + "b");
+    ASSERT_EQ(changes[1].offset, size_t(9999));
+    ASSERT_EQ(changes[1].data, std::string("c"));
+    ASSERT_EQ(FileWriter::getChanges(oldData, oldData).size(), size_t(0));
+    {
+        FileWriter writer(false, 0);
+        writeFile((dir / "f1").string(), oldData);
+        writer.writeChanges(DirEntry(dir / "f1"), changes);
+        ASSERT_EQ(readFile((dir / "f1").string()) == newData, true);
+    }
+
+    // Only the files and no temporary files are left.
+    size_t numEntries = 0;
+    for ([[maybe_unused]] const std::filesystem::directory_entry& entry: std::filesystem::directory_iterator(dir))
+    {
+        numEntries++;
+    }
+    ASSERT_EQ(numEntries, size_t(6));
+    std::filesystem::remove_all(dir);
+}
+
+} // namespace ut1
@@ -0,0 +1,96 @@
+// Writing modified files in place or atomically, with batched syncing.
+//
+// Copyright (c) 2026 Johannes Overmann
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "DirEntry.hpp"
+
+namespace ut1
+{
+
+/// Writer for the new contents of existing files. Thread-safe.
+///
+/// Atomic writes replace a file by a complete temporary file in the same directory (see writeTempFileAt()),
+/// so concurrent readers and a crash see either the old or the new contents, never a truncated file.
+/// Symlinks and files with multiple hardlinks are always written in place to keep the links intact.
+class FileWriter
+{
+public:
+    /// Constructor.
+    /// syncBatchSize: 0: Never sync. 1: Sync each file (before it replaces the original) and its directory.
+    /// N > 1: Sync once per N files using syncfs(). Atomic replacements are deferred until their batch is synced,
+    /// so a crash never leaves an unsynced file in place of an original.
+    FileWriter(bool atomic_, unsigned syncBatchSize_)
+    : atomic(atomic_)
+    , syncBatchSize(syncBatchSize_)
+    {
+    }
+
+    /// Destructor. Flushes the last batch, ignoring errors.
+    ~FileWriter();
+
+    FileWriter(const FileWriter&)            = delete;
+    FileWriter& operator=(const FileWriter&) = delete;
+
+    /// Replace the contents of the file entry by data. Throw std::runtime_error on errors.
+    void write(const DirEntry& entry, std::string_view data);
+
+    /// Replace the file entry by the complete temporary file temp (created for entry), which is synced and replaced like an atomic write.
+    /// Throw std::runtime_error on errors.
+    void replace(const DirEntry& entry, TempFile& temp);
+
+    /// Changed byte range of a file.
+    struct Change
+    {
+        size_t      offset{};
+        std::string data;
+    };
+
+    /// Get the changed byte ranges between two versions of a file of the same size.
+    /// Ranges which are separated by less than kMinUnchanged unchanged bytes are merged.
+    static std::vector<Change> getChanges(std::string_view oldData, std::string_view newData);
+    static constexpr size_t kMinUnchanged = 64;
+
+    /// Return true iff the new contents of files with unchanged size may be written using writeChanges() (not for atomic writes).
+    bool canWriteChanges() const noexcept { return !atomic; }
+
+    /// Write only the changed byte ranges into the file entry (pwrite()), so all other pages of the file stay untouched.
+    /// Throw std::runtime_error on errors.
+    void writeChanges(const DirEntry& entry, const std::vector<Change>& changes);
+
+    /// Sync the current batch and replace the originals. Throw std::runtime_error for the first error (the other files are still processed).
+    void flush();
+
+private:
+    /// File written in the current batch.
+    struct PendingFile
+    {
+        DirEntry    entry;
+        std::string tempName; ///< Replaces entry on flush (empty for in place writes).
+    };
+
+    /// Replace entry by the temporary file tempName now or, when syncing in batches, after the batch is synced.
+    void replaceLater(const DirEntry& entry, std::string tempName);
+
+    /// Add file which was written in place to the current sync batch (if syncing in batches).
+    void syncInPlace(const DirEntry& entry);
+
+    /// Flush with mutex locked.
+    void flushLocked();
+
+    bool     atomic;
+    unsigned syncBatchSize;
+
+    std::mutex               mutex;
+    std::vector<PendingFile> pending;
+};
+
+} // namespace ut1
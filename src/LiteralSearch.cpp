@@ -0,0 +1,258 @@
+// Fast literal substring search.
+//
+// Copyright (c) 2026 Johannes Overmann
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#include "LiteralSearch.hpp"
+#include "MiscUtils.hpp"
+#include "UnitTest.hpp"
+#include <cstring>
+#include <random>
+#include <bit>
+#if defined(__SSE2__) || defined(_M_X64)
+# include <emmintrin.h>
+#endif
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+# include <immintrin.h>
+# define LITERAL_SEARCH_HAVE_AVX2
+#endif
+
+namespace ut1
+{
+
+/// Get frequency rank of a byte (0 = rare, 255 = very common).
+/// This is a static heuristic for source code, text and binary files.
+static unsigned getByteRank(unsigned char c)
+{
+    // Most common chars first.
+    static constexpr std::string_view kCommon = " e\ntaoinsrhldcumfpgwybv_,.;()=kxjqz0123456789\"'-/*{}<>#:ETAOINSRHLDCUMFPGWYBVKXJQZ\t\r[]&+!|\\";
+    size_t index = kCommon.find(char(c));
+    if (index != std::string_view::npos)
+    {
+        return unsigned(255 - index * 2);
+    }
+    if ((c == 0x00) || (c == 0xff))
+    {
+        // Very common in binary files.
+        return 250;
+    }
+    return 10;
+}
+
+
+LiteralSearcher::LiteralSearcher(const std::string& needle_, bool ignoreCase_)
+: needle(ignoreCase_ ? tolower(needle_) : needle_)
+, ignoreCase(ignoreCase_)
+{
+    if (needle.empty())
+    {
+        return;
+    }
+
+    // Pick the rarest byte (other than the first byte) as the second anchor.
+    // Prefer later positions on ties to spread the two anchors.
+    unsigned bestRank = ~0u;
+    for (size_t i = (needle.size() > 1) ? 1 : 0; i < needle.size(); i++)
+    {
+        unsigned rank = getByteRank(static_cast<unsigned char>(needle[i]));
+        if (ignoreCase)
+        {
+            rank = std::max(rank, getByteRank(static_cast<unsigned char>(toupper(needle[i]))));
+        }
+        if (rank <= bestRank)
+        {
+            bestRank  = rank;
+            rareIndex = i;
+        }
+    }
+
+    firstLower = needle[0];
+    firstUpper = ignoreCase ? toupper(needle[0]) : needle[0];
+    rareLower  = needle[rareIndex];
+    rareUpper  = ignoreCase ? toupper(needle[rareIndex]) : needle[rareIndex];
+}
+
+
+bool LiteralSearcher::verify(const char* p) const noexcept
+{
+    if (!ignoreCase)
+    {
+        return std::memcmp(p, needle.data(), needle.size()) == 0;
+    }
+    for (size_t i = 0; i < needle.size(); i++)
+    {
+        if (tolower(p[i]) != needle[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+size_t LiteralSearcher::find(std::string_view haystack, size_t pos) const noexcept
+{
+    if (pos > haystack.size())
+    {
+        return std::string::npos;
+    }
+    if (needle.empty())
+    {
+        return pos;
+    }
+    if (haystack.size() - pos < needle.size())
+    {
+        return std::string::npos;
+    }
+
+    const char* begin = haystack.data();
+    const char* p     = begin + pos;
+    const char* end   = begin + haystack.size();
+
+#ifdef LITERAL_SEARCH_HAVE_AVX2
+    static const bool haveAvx2 = __builtin_cpu_supports("avx2");
+    if (haveAvx2)
+    {
+        return findAvx2(begin, p, end);
+    }
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+    return findSse2(begin, p, end);
+#else
+    return findScalar(begin, p, end);
+#endif
+}
+
+
+size_t LiteralSearcher::findScalar(const char* begin, const char* p, const char* end) const noexcept
+{
+    const size_t n = needle.size();
+    for (; p + n <= end; p++)
+    {
+        if (((p[0] == firstLower) || (p[0] == firstUpper)) && ((p[rareIndex] == rareLower) || (p[rareIndex] == rareUpper)) && verify(p))
+        {
+            return size_t(p - begin);
+        }
+    }
+    return std::string::npos;
+}
+
+
+#if defined(__SSE2__) || defined(_M_X64)
+size_t LiteralSearcher::findSse2(const char* begin, const char* p, const char* end) const noexcept
+{
+    const size_t  n      = needle.size();
+    const __m128i first0 = _mm_set1_epi8(firstLower);
+    const __m128i first1 = _mm_set1_epi8(firstUpper);
+    const __m128i rare0  = _mm_set1_epi8(rareLower);
+    const __m128i rare1  = _mm_set1_epi8(rareUpper);
+    for (; p + rareIndex + 16 <= end; p += 16)
+    {
+        const __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        const __m128i blockRare  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + rareIndex));
+        const __m128i eqFirst    = _mm_or_si128(_mm_cmpeq_epi8(blockFirst, first0), _mm_cmpeq_epi8(blockFirst, first1));
+        const __m128i eqRare     = _mm_or_si128(_mm_cmpeq_epi8(blockRare, rare0), _mm_cmpeq_epi8(blockRare, rare1));
+        unsigned      mask       = unsigned(_mm_movemask_epi8(_mm_and_si128(eqFirst, eqRare)));
+        while (mask)
+        {
+            const char* candidate = p + std::countr_zero(mask);
+            if (candidate + n > end)
+            {
+                return std::string::npos;
+            }
+            if (verify(candidate))
+            {
+                return size_t(candidate - begin);
+            }
+            mask &= mask - 1;
+        }
+    }
+    return findScalar(begin, p, end);
+}
+#endif
+
+
+#ifdef LITERAL_SEARCH_HAVE_AVX2
+__attribute__((target("avx2"))) size_t LiteralSearcher::findAvx2(const char* begin, const char* p, const char* end) const noexcept
+{
+    const size_t  n      = needle.size();
+    const __m256i first0 = _mm256_set1_epi8(firstLower);
+    const __m256i first1 = _mm256_set1_epi8(firstUpper);
+    const __m256i rare0  = _mm256_set1_epi8(rareLower);
+    const __m256i rare1  = _mm256_set1_epi8(rareUpper);
+    for (; p + rareIndex + 32 <= end; p += 32)
+    {
+        const __m256i blockFirst = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        const __m256i blockRare  = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + rareIndex));
+        const __m256i eqFirst    = _mm256_or_si256(_mm256_cmpeq_epi8(blockFirst, first0), _mm256_cmpeq_epi8(blockFirst, first1));
+        const __m256i eqRare     = _mm256_or_si256(_mm256_cmpeq_epi8(blockRare, rare0), _mm256_cmpeq_epi8(blockRare, rare1));
+        unsigned      mask       = unsigned(_mm256_movemask_epi8(_mm256_and_si256(eqFirst, eqRare)));
+        while (mask)
+        {
+            const char* candidate = p + std::countr_zero(mask);
+            if (candidate + n > end)
+            {
+                return std::string::npos;
+            }
+            if (verify(candidate))
+            {
+                return size_t(candidate - begin);
+            }
+            mask &= mask - 1;
+        }
+    }
+    return findScalar(begin, p, end);
+}
+#endif
+
+
+UNIT_TEST(LiteralSearcher)
+{
+    ASSERT_EQ(LiteralSearcher("foo").find("foo"), size_t(0));
+    ASSERT_EQ(LiteralSearcher("foo").find("xfoo"), size_t(1));
+    ASSERT_EQ(LiteralSearcher("foo").find("xfo"), std::string::npos);
+    ASSERT_EQ(LiteralSearcher("foo").find(""), std::string::npos);
+    ASSERT_EQ(LiteralSearcher("foo").find("foofoo", 1), size_t(3));
+    ASSERT_EQ(LiteralSearcher("foo").find("foo", 4), std::string::npos);
+    ASSERT_EQ(LiteralSearcher("").find("abc", 2), size_t(2));
+    ASSERT_EQ(LiteralSearcher("x").find("abcdefghijklmnopqrstuvwxyz0123456789"), size_t(23));
+    ASSERT_EQ(LiteralSearcher(std::string("\0\xff", 2)).find(std::string("abc\0\xff", 5)), size_t(3));
+    ASSERT_EQ(LiteralSearcher("FoO", true).find("xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxfOo"), size_t(36));
+    ASSERT_EQ(LiteralSearcher("foo", true).find("f0o fOx"), std::string::npos);
+    ASSERT_EQ(LiteralSearcher("ab").getRareIndex(), size_t(1));
+}
+
+
+UNIT_TEST(LiteralSearcher_random)
+{
+    // Compare against std::string::find() for all alignments and for needles which straddle the SIMD block boundaries.
+    std::mt19937 rng(42);
+    for (int iteration = 0; iteration < 2000; iteration++)
+    {
+        std::string haystack(rng() % 200, 'a');
+        for (char& c: haystack)
+        {
+            c = "abcAB\n"[rng() % 6];
+        }
+        size_t      len    = 1 + rng() % 8;
+        size_t      start  = haystack.empty() ? 0 : rng() % haystack.size();
+        std::string needle = haystack.substr(start, len);
+        if ((rng() % 4) == 0)
+        {
+            needle += 'z';
+        }
+        if (needle.empty())
+        {
+            continue;
+        }
+        size_t          pos = haystack.empty() ? 0 : rng() % haystack.size();
+        LiteralSearcher searcher(needle);
+        ASSERT_EQ(searcher.find(haystack, pos), haystack.find(needle, pos));
+        LiteralSearcher searcherIcase(toupper(needle), true);
+        ASSERT_EQ(searcherIcase.find(haystack, pos), tolower(haystack).find(tolower(needle), pos));
+    }
+}
+
+} // namespace ut1
@@ -0,0 +1,77 @@
+// Fast literal substring search.
+//
+// Copyright (c) 2026 Johannes Overmann
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace ut1
+{
+
+/// Literal substring searcher.
+///
+/// The needle is preprocessed once and can then be searched in any number of
+/// haystacks. Candidates are located by comparing two anchor bytes of the
+/// needle (the first byte and the rarest byte according to a static byte
+/// frequency heuristic) against 16/32 haystack positions at once using
+/// SSE2/AVX2. Candidates are then verified by comparing the whole needle.
+/// A scalar implementation is used on platforms without SSE2.
+class LiteralSearcher
+{
+public:
+    /// Constructor.
+    /// ignoreCase compares ASCII letters case-insensitively.
+    explicit LiteralSearcher(const std::string& needle_, bool ignoreCase_ = false);
+
+    /// Find needle in haystack, starting at pos.
+    /// Return std::string::npos if not found.
+    /// An empty needle is found at pos (if pos <= haystack.size()).
+    size_t find(std::string_view haystack, size_t pos = 0) const noexcept;
+
+    /// Get needle (lowercase if ignoring case).
+    const std::string& getNeedle() const noexcept { return needle; }
+
+    /// Get needle length.
+    size_t size() const noexcept { return needle.size(); }
+
+    /// Return true iff the needle is empty.
+    bool empty() const noexcept { return needle.empty(); }
+
+    /// Get index of the second (rare) anchor byte.
+    size_t getRareIndex() const noexcept { return rareIndex; }
+
+private:
+    /// Return true iff the needle matches at p (p must have at least needle.size() bytes).
+    bool verify(const char* p) const noexcept;
+
+    /// Scalar search.
+    size_t findScalar(const char* begin, const char* p, const char* end) const noexcept;
+
+#if defined(__SSE2__) || defined(_M_X64)
+    /// SSE2 search.
+    size_t findSse2(const char* begin, const char* p, const char* end) const noexcept;
+#endif
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+    /// AVX2 search (selected at runtime if the CPU supports it).
+    size_t findAvx2(const char* begin, const char* p, const char* end) const noexcept;
+#endif
+
+    std::string needle;
+    bool        ignoreCase{};
+
+    /// Index of the second anchor byte in needle.
+    size_t rareIndex{};
+
+    /// Anchor bytes in both cases (both entries are identical if case does not matter).
+    char firstLower{};
+    char firstUpper{};
+    char rareLower{};
+    char rareUpper{};
+};
+
+} // namespace ut1
@@ -10,6 +10,11 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <csignal>
+#else
+#include <io.h>
 #endif
 #ifdef __APPLE__
 #include <sys/disk.h> // for DKIOCGETBLOCKCOUNT and DKIOCGETBLOCKSIZE
@@ -23,9 +28,12 @@
 #include <cstring>
 #include <iostream>
 #include <array>
+#include <atomic>
 #include <chrono>
 #include <format>
 #include <iomanip>
+#include <mutex>
+#include <system_error>
 #include <utility>
 
 
@@ -588,33 +596,45 @@ UNIT_TEST(joinStrings)
 
 UNIT_TEST(regex_replace)
 {
-    ASSERT_EQ(regex_replace("aa XX bb YY cc", std::regex("[A-Z]+"), [&](const std::smatch& match)
+    ASSERT_EQ(regex_replace("aa XX bb YY cc", std::regex("[A-Z]+"), [&](const std::cmatch& match)
                   { return "(" + match[0].str() + ")"; }),
         "aa (XX) bb (YY) cc");
-    ASSERT_EQ(regex_replace("XX bb YY cc", std::regex("[A-Z]+"), [&](const std::smatch& match)
+    ASSERT_EQ(regex_replace("XX bb YY cc", std::regex("[A-Z]+"), [&](const std::cmatch& match)
                   { return "(" + match[0].str() + ")"; }),
         "(XX) bb (YY) cc");
-    ASSERT_EQ(regex_replace("aa XX bb YY", std::regex("[A-Z]+"), [&](const std::smatch& match)
+    ASSERT_EQ(regex_replace("aa XX bb YY", std::regex("[A-Z]+"), [&](const std::cmatch& match)
                   { return "(" + match[0].str() + ")"; }),
         "aa (XX) bb (YY)");
-    ASSERT_EQ(regex_replace("aa", std::regex("bb"), [&](const std::smatch& match)
+    ASSERT_EQ(regex_replace("aa", std::regex("bb"), [&](const std::cmatch& match)
                   { return match[0].str(); }),
         "aa");
-    ASSERT_EQ(regex_replace("", std::regex("bb"), [&](const std::smatch& match)
+    ASSERT_EQ(regex_replace("", std::regex("bb"), [&](const std::cmatch& match)
                   { return match[0].str(); }),
         "");
-    ASSERT_EQ(regex_replace("aa", std::regex("aa"), [&](const std::smatch& match)
+    ASSERT_EQ(regex_replace("aa", std::regex("aa"), [&](const std::cmatch& match)
                   { return match[0].str(); }),
         "aa");
-    ASSERT_EQ(regex_replace("aa XX bb YY cc", std::regex("[A-Z]+"), [&](const std::smatch& match)
+    ASSERT_EQ(regex_replace("aa XX bb YY cc", std::regex("[A-Z]+"), [&](const std::cmatch& match)
                   { return tolower(match[0].str()); }),
         "aa xx bb yy cc");
-    ASSERT_EQ(regex_replace("aa XX bb YY cc", std::regex("[A-Z]+"), [&](const std::smatch& match)
+    ASSERT_EQ(regex_replace("aa XX bb YY cc", std::regex("[A-Z]+"), [&](const std::cmatch& match)
                   { return match.format("f($&)"); }),
         "aa f(XX) bb f(YY) cc");
-    ASSERT_EQ(regex_replace("aa XX.jpg bb YY.jpg cc", std::regex("([A-Z]+)[.]jpg"), [&](const std::smatch& match)
+    ASSERT_EQ(regex_replace("aa XX.jpg bb YY.jpg cc", std::regex("([A-Z]+)[.]jpg"), [&](const std::cmatch& match)
                   { return match.format("pic_$1.png"); }),
         "aa pic_XX.png bb pic_YY.png cc");
+
+    // Output sink variant.
+    std::string out = "x";
+    ASSERT_EQ(regex_replace(out, "aa XX bb YY cc", std::regex("[A-Z]+"), [&](std::string& r, const std::cmatch& match)
+                  { r += "(" + match[0].str() + ")"; }),
+        size_t(2));
+    ASSERT_EQ(out, "xaa (XX) bb (YY) cc");
+    out.clear();
+    ASSERT_EQ(regex_replace(out, "aa", std::regex("bb"), [&](std::string&, const std::cmatch&) {}), size_t(0));
+    ASSERT_EQ(out, "");
+    ASSERT_EQ(regex_replace(out, "aXa", std::regex("a"), [&](std::string&, const std::cmatch&) {}), size_t(2));
+    ASSERT_EQ(out, "X");
 }
 
 
@@ -761,7 +781,7 @@ std::string quoteRegexChars(const std::string& s)
 UNIT_TEST(quoteRegexChars)
 {
     std::string r = "^[F][O][O]a.a*a+a|a?a{}a()a?\\$";
-    ASSERT_EQ(ut1::regex_replace("A" + r + "B", std::regex(quoteRegexChars(r)), [&](const std::smatch&)
+    ASSERT_EQ(ut1::regex_replace("A" + r + "B", std::regex(quoteRegexChars(r)), [&](const std::cmatch&)
                   { return "X"; }),
         "AXB");
 }
@@ -1079,7 +1099,28 @@ std::string readFile(const std::string& filename)
 }
 
 
-void writeFile(const std::string& filename, const std::string& data)
+size_t readSome(int fd, char* data, size_t size, const std::string& name)
+{
+    while (true)
+    {
+#ifdef _WIN32
+        int n = ::_read(fd, data, unsigned(std::min(size, size_t(1) << 30)));
+#else
+        ssize_t n = ::read(fd, data, size);
+#endif
+        if (n >= 0)
+        {
+            return size_t(n);
+        }
+        if (errno != EINTR)
+        {
+            throw std::runtime_error(std::format("readSome({}): Error while reading: {}.", name, std::strerror(errno)));
+        }
+    }
+}
+
+
+void writeFile(const std::string& filename, std::string_view data)
 {
     std::ofstream os(filename, std::ios::out | std::ios::binary | std::ios::trunc);
     if (!os)
@@ -1098,13 +1139,754 @@ void writeFile(const std::string& filename, const std::string& data)
     }
 }
 
+#ifndef _WIN32
+/// Write all data to fd and optionally sync it. Close fd and throw std::runtime_error on errors.
+static void writeAllAndSync(int fd, const std::string& filename, std::string_view data, bool sync)
+{
+    while (!data.empty())
+    {
+        ssize_t n = ::write(fd, data.data(), data.size());
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            const std::string error = std::strerror(errno);
+            ::close(fd);
+            throw std::runtime_error(std::format("writeFile({}): Error while writing file: {}.", filename, error));
+        }
+        data.remove_prefix(size_t(n));
+    }
+    if (sync && (::fsync(fd) == -1))
+    {
+        const std::string error = std::strerror(errno);
+        ::close(fd);
+        throw std::runtime_error(std::format("writeFile({}): Error while syncing file: {}.", filename, error));
+    }
+}
+
+
+void writeFileAt(int dirFd, const std::string& filename, std::string_view data, bool sync)
+{
+    int fd = ::openat(dirFd, filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd == -1)
+    {
+        throw std::runtime_error(std::format("writeFile({}): Error while opening file for writing: {}.", filename, std::strerror(errno)));
+    }
+    writeAllAndSync(fd, filename, data, sync);
+    if (::close(fd) == -1)
+    {
+        throw std::runtime_error(std::format("writeFile({}): Error while closing file: {}.", filename, std::strerror(errno)));
+    }
+}
+
+
+TempFile::TempFile(int dirFd_, const std::string& filename_)
+: dirFd(dirFd_)
+, filename(filename_)
+{
+    struct stat st;
+    if (::fstatat(dirFd, filename.c_str(), &st, AT_SYMLINK_NOFOLLOW) == -1)
+    {
+        throw std::runtime_error(std::format("writeFile({}): Error while stat()ing file: {}.", filename, std::strerror(errno)));
+    }
+    if (!S_ISREG(st.st_mode) || (st.st_nlink > 1))
+    {
+        return;
+    }
+
+    // Anonymous file which is linked into the directory when it is complete.
+    size_t      slash = filename.rfind('/');
+    std::string dir   = (slash == std::string::npos) ? std::string(".") : filename.substr(0, slash + 1);
+#ifdef O_TMPFILE
+    fd        = ::openat(dirFd, dir.c_str(), O_TMPFILE | O_WRONLY | O_CLOEXEC, 0600);
+    anonymous = fd != -1;
+#endif
+    // Fallback for filesystems without O_TMPFILE support: Named temporary file.
+    while (fd == -1)
+    {
+        tempName = getTempName();
+        fd       = ::openat(dirFd, tempName.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if ((fd == -1) && (errno != EEXIST))
+        {
+            tempName.clear();
+            throw std::runtime_error(std::format("writeFile({}): Error while creating temporary file: {}.", filename, std::strerror(errno)));
+        }
+    }
+
+    // Copy owner first (chown() clears the setuid/setgid bits). This fails for foreign owners unless running as root.
+    struct stat tempSt;
+    if ((::fchown(fd, st.st_uid, st.st_gid) == -1) || (::fstat(fd, &tempSt) == -1) ||
+        (tempSt.st_uid != st.st_uid) || (tempSt.st_gid != st.st_gid))
+    {
+        // Replacing the file would change its owner: leave it to be written in place.
+        discard();
+        return;
+    }
+    if (::fchmod(fd, st.st_mode & 07777) == -1)
+    {
+        const std::string error = std::strerror(errno);
+        discard();
+        throw std::runtime_error(std::format("writeFile({}): Error while setting mode of temporary file: {}.", filename, error));
+    }
+}
+
+
+TempFile::~TempFile()
+{
+    discard();
+}
+
+
+std::string TempFile::getTempName() const
+{
+    // Unique temporary name in the same directory (rename() does not work across filesystems).
+    static std::atomic<uint64_t> counter{};
+    size_t slash = filename.rfind('/');
+    return std::format("{}.{}.{}.{}.tmp", filename.substr(0, slash + 1), filename.substr(slash + 1), ::getpid(), counter++);
+}
+
+
+void TempFile::discard() noexcept
+{
+    if (fd != -1)
+    {
+        ::close(fd);
+        fd = -1;
+    }
+    if (!tempName.empty())
+    {
+        ::unlinkat(dirFd, tempName.c_str(), 0);
+        tempName.clear();
+    }
+}
+
+
+void TempFile::write(std::string_view data)
+{
+    try
+    {
+        writeAllAndSync(fd, filename, data, false);
+    }
+    catch (const std::exception&)
+    {
+        // writeAllAndSync() closed fd.
+        fd = -1;
+        discard();
+        throw;
+    }
+}
+
+
+std::string TempFile::commit(bool sync)
+{
+    if (sync && (::fsync(fd) == -1))
+    {
+        const std::string error = std::strerror(errno);
+        discard();
+        throw std::runtime_error(std::format("writeFile({}): Error while syncing file: {}.", filename, error));
+    }
+#ifdef O_TMPFILE
+    while (anonymous)
+    {
+        tempName = getTempName();
+        // linkat(AT_EMPTY_PATH) needs CAP_DAC_READ_SEARCH, /proc works for everybody.
+        std::string procPath = std::format("/proc/self/fd/{}", fd);
+        int         r        = ::linkat(AT_FDCWD, procPath.c_str(), dirFd, tempName.c_str(), AT_SYMLINK_FOLLOW);
+        if ((r == -1) && (errno == ENOENT))
+        {
+            r = ::linkat(fd, "", dirFd, tempName.c_str(), AT_EMPTY_PATH);
+        }
+        if (r == 0)
+        {
+            break;
+        }
+        if (errno != EEXIST)
+        {
+            const std::string error = std::strerror(errno);
+            tempName.clear();
+            discard();
+            throw std::runtime_error(std::format("writeFile({}): Error while linking temporary file: {}.", filename, error));
+        }
+    }
+#endif
+    int closeResult = ::close(fd);
+    fd              = -1;
+    if (closeResult == -1)
+    {
+        const std::string error = std::strerror(errno);
+        discard();
+        throw std::runtime_error(std::format("writeFile({}): Error while closing temporary file: {}.", filename, error));
+    }
+    return std::exchange(tempName, std::string());
+}
+
+
+std::string writeTempFileAt(int dirFd, const std::string& filename, std::string_view data, bool sync)
+{
+    TempFile temp(dirFd, filename);
+    if (!temp.isOpen())
+    {
+        return std::string();
+    }
+    temp.write(data);
+    return temp.commit(sync);
+}
+
+
+void replaceFileAt(int dirFd, const std::string& tempName, const std::string& filename)
+{
+    if (::renameat(dirFd, tempName.c_str(), dirFd, filename.c_str()) == -1)
+    {
+        const std::string error = std::strerror(errno);
+        ::unlinkat(dirFd, tempName.c_str(), 0);
+        throw std::runtime_error(std::format("writeFile({}): Error while replacing file: {}.", filename, error));
+    }
+}
+#else
+// No temporary files on Windows: isOpen() is always false, so files are written at once.
+TempFile::TempFile(int dirFd_, const std::string& filename_)
+: dirFd(dirFd_)
+, filename(filename_)
+{
+}
+
+
+TempFile::~TempFile()
+{
+}
+
+
+void TempFile::write(std::string_view)
+{
+    throw std::runtime_error(std::format("writeFile({}): Temporary files are not supported.", filename));
+}
+
+
+std::string TempFile::commit(bool)
+{
+    throw std::runtime_error(std::format("writeFile({}): Temporary files are not supported.", filename));
+}
+#endif
+
+const char* getCopyMethodStr(CopyMethod method)
+{
+    switch (method)
+    {
+    case CopyMethod::REFLINK: return "reflink";
+    case CopyMethod::COPY_FILE_RANGE: return "copy_file_range";
+    case CopyMethod::READ_WRITE: return "read/write";
+    }
+    return "unknown";
+}
+
+
+#ifndef _WIN32
+CopyMethod copyFileAt(int srcDirFd, const std::string& src, int dstDirFd, const std::string& dst)
+{
+    int srcFd = ::openat(srcDirFd, src.c_str(), O_RDONLY | O_CLOEXEC);
+    if (srcFd == -1)
+    {
+        throw std::runtime_error(std::format("copyFile({}): Error while opening file for reading: {}.", src, std::strerror(errno)));
+    }
+    struct stat st;
+    if (::fstat(srcFd, &st) == -1)
+    {
+        const std::string error = std::strerror(errno);
+        ::close(srcFd);
+        throw std::runtime_error(std::format("copyFile({}): Error while fstat()ing file: {}.", src, error));
+    }
+    int dstFd = ::openat(dstDirFd, dst.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, st.st_mode & 07777);
+    if (dstFd == -1)
+    {
+        const std::string error = std::strerror(errno);
+        ::close(srcFd);
+        throw std::runtime_error(std::format("copyFile({}): Error while creating file: {}.", dst, error));
+    }
+    auto fail = [&](const char* what)
+    {
+        const std::string error = std::strerror(errno);
+        ::close(srcFd);
+        ::close(dstFd);
+        ::unlinkat(dstDirFd, dst.c_str(), 0);
+        throw std::runtime_error(std::format("copyFile({}): Error while {}: {}.", dst, what, error));
+    };
+    if (::fchmod(dstFd, st.st_mode & 07777) == -1)
+    {
+        fail("setting mode");
+    }
+
+    CopyMethod method = CopyMethod::READ_WRITE;
+#ifdef FICLONE
+    if (::ioctl(dstFd, FICLONE, srcFd) == 0)
+    {
+        method = CopyMethod::REFLINK;
+    }
+#endif
+#ifdef __linux__
+    // Falls back to read()/write() on errors before anything is copied (e.g. EXDEV on old kernels, ENOSYS, EINVAL for special files).
+    bool copied = false;
+    while (method == CopyMethod::READ_WRITE)
+    {
+        ssize_t n = ::copy_file_range(srcFd, nullptr, dstFd, nullptr, size_t(1) << 30, 0);
+        if (n == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (copied)
+            {
+                fail("copying file");
+            }
+            break;
+        }
+        if (n == 0)
+        {
+            if (copied || (st.st_size == 0))
+            {
+                method = CopyMethod::COPY_FILE_RANGE;
+            }
+            // Pseudo files report size 0 and copy nothing.
+            break;
+        }
+        copied = true;
+    }
+#endif
+    if (method == CopyMethod::READ_WRITE)
+    {
+        // Continue where copy_file_range() stopped (file offsets are shared).
+        std::array<char, 65536> chunk;
+        while (true)
+        {
+            ssize_t n = ::read(srcFd, chunk.data(), chunk.size());
+            if (n == 0)
+            {
+                break;
+            }
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                fail("reading file");
+            }
+            for (ssize_t pos = 0; pos < n;)
+            {
+                ssize_t w = ::write(dstFd, chunk.data() + pos, size_t(n - pos));
+                if (w < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    fail("writing file");
+                }
+                pos += w;
+            }
+        }
+    }
+    ::close(srcFd);
+    if (::close(dstFd) == -1)
+    {
+        fail("closing file");
+    }
+    return method;
+}
+#endif
+
+
+#ifndef _WIN32
+UNIT_TEST(readSome)
+{
+    // Pipes return the available data.
+    std::array<int, 2> fds;
+    ASSERT_EQ(::pipe(fds.data()), 0);
+    ASSERT_EQ(::write(fds[1], "abc", 3), ssize_t(3));
+    std::array<char, 10> data;
+    ASSERT_EQ(readSome(fds[0], data.data(), data.size(), "pipe"), size_t(3));
+    ASSERT_EQ(std::string_view(data.data(), 3), "abc");
+    ::close(fds[1]);
+    ASSERT_EQ(readSome(fds[0], data.data(), data.size(), "pipe"), size_t(0));
+    ::close(fds[0]);
+}
+#endif
+
+
 UNIT_TEST(readFile_writeFile)
 {
     std::string filename = "MiscUtilsTmp";
     writeFile(filename, "abc");
     std::string s = readFile(filename);
     ASSERT_EQ(s, "abc");
+#ifndef _WIN32
+    writeFileAt(AT_FDCWD, filename, "de", true);
+    ASSERT_EQ(readFile(filename), "de");
+
+    // Atomic replacement keeps the mode.
+    ::chmod(filename.c_str(), 0640);
+    std::string tempName = writeTempFileAt(AT_FDCWD, filename, "fgh", true);
+    ASSERT_EQ(tempName.empty(), false);
+    ASSERT_EQ(readFile(filename), "de");
+    replaceFileAt(AT_FDCWD, tempName, filename);
+    ASSERT_EQ(readFile(filename), "fgh");
+    ASSERT_EQ(fsExists(tempName), false);
+    struct stat st;
+    ::stat(filename.c_str(), &st);
+    ASSERT_EQ(unsigned(st.st_mode & 07777), 0640u);
+
+    // Hardlinked files are not replaced.
+    ::link(filename.c_str(), (filename + "2").c_str());
+    ASSERT_EQ(writeTempFileAt(AT_FDCWD, filename, "x"), std::string());
+    std::filesystem::remove(filename + "2");
+
+    // Temporary files written piecewise are removed unless they are committed.
+    {
+        TempFile temp(AT_FDCWD, filename);
+        temp.write("x");
+    }
+    {
+        TempFile temp(AT_FDCWD, filename);
+        ASSERT_EQ(temp.isOpen(), true);
+        temp.write("f");
+        temp.write("gh");
+        replaceFileAt(AT_FDCWD, temp.commit(false), filename);
+        ASSERT_EQ(temp.isOpen(), false);
+    }
+    ASSERT_EQ(readFile(filename), "fgh");
+
+    // Copy.
+    CopyMethod method = copyFileAt(AT_FDCWD, filename, AT_FDCWD, filename + "2");
+    ASSERT_EQ(readFile(filename + "2"), "fgh");
+    ::stat((filename + "2").c_str(), &st);
+    ASSERT_EQ(unsigned(st.st_mode & 07777), 0640u);
+#ifdef __linux__
+    ASSERT_EQ(method != CopyMethod::READ_WRITE, true);
+#else
+    ASSERT_EQ(int(method), int(CopyMethod::READ_WRITE));
+#endif
+    bool thrown = false;
+    try
+    {
+        copyFileAt(AT_FDCWD, filename, AT_FDCWD, filename + "2");
+    }
+    catch (const std::runtime_error&)
+    {
+        thrown = true;
+    }
+    ASSERT_EQ(thrown, true);
+    std::filesystem::remove(filename + "2");
+#endif
+    std::filesystem::remove(filename);
+}
+
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::string& filename)
+{
+    buffer = readFile(filename);
+}
+#else
+/// Mapped files which are guarded against SIGBUS (see MappedFile::wasTruncated()).
+/// The signal handler only reads these atomics, so guarding and unguarding do not need a lock.
+struct GuardedMapping
+{
+    std::atomic<bool>      used{};
+    std::atomic<uintptr_t> begin{}; ///< 0: Free (set last when a mapping is guarded, cleared first when it is unguarded).
+    std::atomic<size_t>    size{};
+    std::atomic<bool>      truncated{};
+};
+static constexpr size_t                               kMaxGuardedMappings = 4096;
+static std::array<GuardedMapping, kMaxGuardedMappings> guardedMappings;
+static size_t                                          guardPageSize{};
+static struct sigaction                                oldSigBusAction;
+
+
+/// SIGBUS handler: Reading a page of a mapped file beyond the end of the file (because it was truncated after it was mapped) raises SIGBUS.
+/// Replace the rest of the mapping by zero pages, so the read returns 0, and mark the mapping as truncated.
+/// For all other faults the previous action is restored, which then handles the fault when the instruction is executed again.
+static void handleSigBus(int, siginfo_t* info, void*)
+{
+    uintptr_t addr = reinterpret_cast<uintptr_t>(info->si_addr);
+    for (GuardedMapping& mapping: guardedMappings)
+    {
+        uintptr_t begin = mapping.begin.load(std::memory_order_acquire);
+        if ((begin != 0) && (addr >= begin) && (addr - begin < mapping.size))
+        {
+            uintptr_t page = addr & ~uintptr_t(guardPageSize - 1);
+            uintptr_t end  = (begin + mapping.size + guardPageSize - 1) & ~uintptr_t(guardPageSize - 1);
+            if (::mmap(reinterpret_cast<void*>(page), end - page, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != MAP_FAILED)
+            {
+                mapping.truncated = true;
+                return;
+            }
+            break;
+        }
+    }
+    ::sigaction(SIGBUS, &oldSigBusAction, nullptr);
+}
+
+
+/// Guard mapping of size bytes at data against SIGBUS (installing the handler on first use).
+/// Return the index of the guard, or -1 if too many mappings are guarded.
+static int guardMapping(const void* data, size_t size) noexcept
+{
+    static std::once_flag once;
+    std::call_once(once, []()
+        {
+            guardPageSize = size_t(::sysconf(_SC_PAGESIZE));
+            struct sigaction action{};
+            action.sa_sigaction = handleSigBus;
+            action.sa_flags     = SA_SIGINFO;
+            sigemptyset(&action.sa_mask);
+            ::sigaction(SIGBUS, &action, &oldSigBusAction);
+        });
+    static std::atomic<size_t> next{};
+    size_t start = next++;
+    for (size_t i = 0; i < kMaxGuardedMappings; i++)
+    {
+        size_t          index    = (start + i) % kMaxGuardedMappings;
+        GuardedMapping& mapping  = guardedMappings[index];
+        bool            expected = false;
+        if (mapping.used.compare_exchange_strong(expected, true))
+        {
+            mapping.size      = size;
+            mapping.truncated = false;
+            mapping.begin.store(reinterpret_cast<uintptr_t>(data), std::memory_order_release);
+            return int(index);
+        }
+    }
+    return -1;
+}
+
+
+/// Remove guard returned by guardMapping().
+static void unguardMapping(int index) noexcept
+{
+    guardedMappings[size_t(index)].begin = 0;
+    guardedMappings[size_t(index)].used  = false;
+}
+
+
+MappedFile::MappedFile(const std::string& filename)
+: MappedFile(AT_FDCWD, filename)
+{
+}
+
+
+MappedFile::MappedFile(int dirFd, const std::string& filename)
+{
+    int fd = ::openat(dirFd, filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        throw std::system_error(errno, std::generic_category(), std::format("MappedFile({}): Error while opening file for reading", filename));
+    }
+    struct stat st;
+    if (::fstat(fd, &st) == -1)
+    {
+        const std::string error = std::strerror(errno);
+        ::close(fd);
+        throw std::runtime_error(std::format("MappedFile({}): Error while fstat()ing file: {}.", filename, error));
+    }
+
+    if (S_ISREG(st.st_mode) && (st.st_size > 0))
+    {
+        // Files are only mapped if the mapping can be guarded against SIGBUS (the file may be truncated by another process meanwhile).
+        void* p = ::mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED)
+        {
+            guard = guardMapping(p, size_t(st.st_size));
+            if (guard >= 0)
+            {
+                ::madvise(p, size_t(st.st_size), MADV_SEQUENTIAL);
+                mapData = static_cast<const char*>(p);
+                mapSize = size_t(st.st_size);
+                mapped  = true;
+                ::close(fd);
+                return;
+            }
+            ::munmap(p, size_t(st.st_size));
+        }
+    }
+
+    // Read pipes, special files and files which cannot be mapped.
+    if (S_ISREG(st.st_mode))
+    {
+        buffer.reserve(size_t(st.st_size));
+    }
+    std::array<char, 65536> chunk;
+    while (true)
+    {
+        ssize_t n = ::read(fd, chunk.data(), chunk.size());
+        if (n == 0)
+        {
+            break;
+        }
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            const std::string error = std::strerror(errno);
+            ::close(fd);
+            throw std::runtime_error(std::format("MappedFile({}): Error while reading file: {}.", filename, error));
+        }
+        buffer.append(chunk.data(), size_t(n));
+    }
+    ::close(fd);
+}
+#endif
+
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+: mapData(std::exchange(other.mapData, nullptr))
+, mapSize(std::exchange(other.mapSize, 0))
+, mapped(std::exchange(other.mapped, false))
+, discardedSize(std::exchange(other.discardedSize, 0))
+, guard(std::exchange(other.guard, -1))
+, buffer(std::move(other.buffer))
+{
+}
+
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if (this != &other)
+    {
+        close();
+        mapData       = std::exchange(other.mapData, nullptr);
+        mapSize       = std::exchange(other.mapSize, 0);
+        mapped        = std::exchange(other.mapped, false);
+        discardedSize = std::exchange(other.discardedSize, 0);
+        guard         = std::exchange(other.guard, -1);
+        buffer        = std::move(other.buffer);
+    }
+    return *this;
+}
+
+
+void MappedFile::prefault() const noexcept
+{
+#ifndef _WIN32
+    if (mapped)
+    {
+        // Start asynchronous readahead for the whole file, then touch each page.
+        ::madvise(const_cast<char*>(mapData), mapSize, MADV_WILLNEED);
+        const size_t  pageSize = size_t(::sysconf(_SC_PAGESIZE));
+        volatile char sink     = 0;
+        for (size_t i = 0; i < mapSize; i += pageSize)
+        {
+            sink = sink + mapData[i];
+        }
+    }
+#endif
+}
+
+
+void MappedFile::discard(size_t end) noexcept
+{
+#ifndef _WIN32
+    if (mapped)
+    {
+        // Only whole pages, the page containing end may still be needed.
+        const size_t pageSize = size_t(::sysconf(_SC_PAGESIZE));
+        end                   = std::min(end, mapSize) / pageSize * pageSize;
+        if (discardedSize < end)
+        {
+            ::madvise(const_cast<char*>(mapData) + discardedSize, end - discardedSize, MADV_DONTNEED);
+            discardedSize = end;
+        }
+    }
+#endif
+}
+
+
+bool MappedFile::wasTruncated() const noexcept
+{
+#ifndef _WIN32
+    return mapped && guardedMappings[size_t(guard)].truncated;
+#else
+    return false;
+#endif
+}
+
+
+void MappedFile::close() noexcept
+{
+#ifndef _WIN32
+    if (mapped)
+    {
+        ::munmap(const_cast<char*>(mapData), mapSize);
+        unguardMapping(guard);
+    }
+#endif
+    mapData       = nullptr;
+    mapSize       = 0;
+    mapped        = false;
+    discardedSize = 0;
+    guard         = -1;
+    buffer.clear();
+    buffer.shrink_to_fit();
+}
+
+
+UNIT_TEST(MappedFile)
+{
+    std::string filename = "MiscUtilsTmp";
+    writeFile(filename, "abc");
+    {
+        MappedFile file(filename);
+        ASSERT_EQ(file.view(), "abc");
+#ifndef _WIN32
+        ASSERT_EQ(file.isMapped(), true);
+#endif
+        MappedFile moved(std::move(file));
+        moved.prefault();
+        ASSERT_EQ(moved.view(), "abc");
+        ASSERT_EQ(file.size(), size_t(0));
+    }
+    // Discarded pages are read again.
+    std::string data(100000, 'x');
+    data.back() = 'y';
+    writeFile(filename, data);
+    {
+        MappedFile file(filename);
+        ASSERT_EQ(file.view() == data, true);
+        file.discard(file.size());
+        ASSERT_EQ(file.view() == data, true);
+    }
+#ifndef _WIN32
+    // Truncated while mapped: The missing part reads as zero bytes instead of raising SIGBUS.
+    {
+        MappedFile file(filename);
+        ASSERT_EQ(file.wasTruncated(), false);
+        std::filesystem::resize_file(filename, 10);
+        ASSERT_EQ(file.view().substr(0, 10), data.substr(0, 10));
+        ASSERT_EQ(file.view().back(), '\0');
+        ASSERT_EQ(file.wasTruncated(), true);
+        MappedFile other(filename);
+        ASSERT_EQ(other.view(), data.substr(0, 10));
+        ASSERT_EQ(other.wasTruncated(), false);
+    }
+#endif
+    writeFile(filename, "");
+    ASSERT_EQ(MappedFile(filename).size(), size_t(0));
     std::filesystem::remove(filename);
+#ifndef _WIN32
+    // Special file (read() fallback).
+    MappedFile devNull("/dev/null");
+    ASSERT_EQ(devNull.isMapped(), false);
+    ASSERT_EQ(devNull.size(), size_t(0));
+#endif
 }
 
 size_t getFileSize(const std::string& filename)
@@ -1344,5 +2126,30 @@ void setLastWriteTime(const std::filesystem::directory_entry& entry, std::filesy
     utimensat(AT_FDCWD, entry.path().c_str(), t, followSymlinks ? 0 : AT_SYMLINK_NOFOLLOW);
 }
 
+size_t raiseOpenFileLimit(size_t maxLimit)
+{
+#ifdef _WIN32
+    // There is no per-process limit for file handles which is anywhere near maxLimit.
+    return maxLimit;
+#else
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0)
+    {
+        return 256; // POSIX minimum of OPEN_MAX is 20, but practically all systems allow at least 256.
+    }
+    rlim_t wanted = std::min(limit.rlim_max, rlim_t(maxLimit));
+    if (limit.rlim_cur < wanted)
+    {
+        rlim_t old     = limit.rlim_cur;
+        limit.rlim_cur = wanted;
+        if (setrlimit(RLIMIT_NOFILE, &limit) != 0)
+        {
+            limit.rlim_cur = old;
+        }
+    }
+    return size_t(std::min(limit.rlim_cur, rlim_t(maxLimit)));
+#endif
+}
+
 
 } // namespace ut1
@@ -135,23 +135,46 @@ std::vector<std::string> splitLines(const std::string& s, size_t wrapCol = 0);
 /// Join vector of strings.
 std::string joinStrings(const std::vector<std::string>& stringList, const std::string& sep);
 
+/// std::regex_replace() with a callback function which appends the replacement to an output buffer.
+/// For each match appendMatch(out, match) is called (match is a std::cmatch). Unchanged spans of s are copied to out directly.
+/// If there is no match, out is not modified (so s can be used unchanged by the caller).
+/// Return number of matches.
+template<typename AppendMatch>
+size_t regex_replace(std::string& out, std::string_view s, const std::regex& re, AppendMatch appendMatch)
+{
+    size_t               numMatches = 0;
+    size_t               endOfMatch = 0;
+    std::cregex_iterator end;
+    for (std::cregex_iterator it(s.data(), s.data() + s.size(), re); it != end; it++)
+    {
+        if (numMatches++ == 0)
+        {
+            // Most replacements have a similar length as the original.
+            out.reserve(out.size() + s.size() + s.size() / 8);
+        }
+        size_t pos = size_t(it->position(0));
+        out.append(s, endOfMatch, pos - endOfMatch);
+        appendMatch(out, *it);
+        endOfMatch = pos + size_t(it->length(0));
+    }
+    if (numMatches)
+    {
+        out.append(s, endOfMatch);
+    }
+    return numMatches;
+}
+
+
 /// std::regex_replace() with a callback function instead of a format string.
+/// f(match) returns the replacement for each match (match is a std::cmatch).
 template<typename FormatMatch>
 std::string regex_replace(const std::string& s, const std::regex& re, FormatMatch f)
 {
     std::string r;
-
-    size_t               endOfMatch = 0;
-    std::sregex_iterator end;
-    for (std::sregex_iterator it(s.begin(), s.end(), re); it != end; it++)
+    if (regex_replace(r, std::string_view(s), re, [&](std::string& out, const std::cmatch& match) { out.append(f(match)); }) == 0)
     {
-        r.append(it->prefix());
-        r.append(f(*it));
-        endOfMatch = it->position(0) + it->length(0);
+        return s;
     }
-
-    r.append(s.substr(endOfMatch));
-
     return r;
 }
 
@@ -261,7 +284,147 @@ size_t getLargestPowerOfTwoFactor(size_t size);
 std::string readFile(const std::string& filename);
 
 /// Write string to file.
-void writeFile(const std::string& filename, const std::string& data);
+void writeFile(const std::string& filename, std::string_view data);
+
+/// Read up to size bytes from file descriptor fd into data. Unlike fread() this returns as soon as some data is available (e.g. from a pipe).
+/// Return the number of bytes read (0 at the end of the input). Throw std::runtime_error on errors (name is used in the message).
+size_t readSome(int fd, char* data, size_t size, const std::string& name);
+
+#ifndef _WIN32
+/// Write string to file relative to directory file descriptor dirFd (openat()).
+/// Sync the file to disk (fsync()) if sync is true.
+void writeFileAt(int dirFd, const std::string& filename, std::string_view data, bool sync = false);
+
+/// Write string to a new temporary file in the directory of filename (relative to dirFd), with the mode and owner of filename (see TempFile).
+/// Sync the file to disk if sync is true. Return the name of the temporary file (relative to dirFd).
+/// Return an empty string without writing anything if filename is not a regular file (e.g. a symlink) or has more than one hardlink, since replacing it would break the link.
+std::string writeTempFileAt(int dirFd, const std::string& filename, std::string_view data, bool sync = false);
+
+/// Atomically replace filename by tempName (renameat(), both relative to dirFd). tempName is removed on errors.
+void replaceFileAt(int dirFd, const std::string& tempName, const std::string& filename);
+#endif
+
+/// New temporary file in the directory of a file, which is written piecewise and then replaces the file (see replaceFileAt()).
+/// The file is created with O_TMPFILE where supported, so it only gets a name when it is complete.
+/// It is removed again unless it is committed.
+class TempFile
+{
+public:
+    /// Create temporary file for filename (relative to dirFd) with the mode and owner of filename.
+    /// Nothing is created (isOpen() is false) if filename is not a regular file (e.g. a symlink) or has more than one hardlink,
+    /// since replacing it would break the link, if its owner cannot be copied (e.g. it belongs to another user),
+    /// since replacing it would change the owner, and on Windows. Throw std::runtime_error on errors.
+    TempFile(int dirFd_, const std::string& filename_);
+
+    /// Destructor. Removes the file unless it was committed.
+    ~TempFile();
+
+    TempFile(const TempFile&)            = delete;
+    TempFile& operator=(const TempFile&) = delete;
+
+    /// Return true iff the file was created and is not committed yet.
+    bool isOpen() const noexcept { return fd != -1; }
+
+    /// Append data. Throw std::runtime_error on errors (the file is removed then).
+    void write(std::string_view data);
+
+    /// Sync the file to disk if sync is true, give it a name and close it.
+    /// Return the name of the file (relative to dirFd). Throw std::runtime_error on errors (the file is removed then).
+    std::string commit(bool sync);
+
+private:
+    /// Get a new unique name in the directory of filename.
+    std::string getTempName() const;
+
+    /// Close and remove file.
+    void discard() noexcept;
+
+    int         dirFd{};
+    std::string filename;
+    int         fd{-1};
+    bool        anonymous{};
+    std::string tempName; ///< Empty while the file is anonymous.
+};
+
+/// How copyFileAt() copied a file.
+enum class CopyMethod { REFLINK, COPY_FILE_RANGE, READ_WRITE };
+
+/// Get copy method string.
+const char* getCopyMethodStr(CopyMethod method);
+
+#ifndef _WIN32
+/// Copy file src (relative to srcDirFd) to the new file dst (relative to dstDirFd) with the mode of src.
+/// Use a reflink (FICLONE, shares the data blocks on btrfs/XFS) where supported, else copy_file_range() (in-kernel copy), else read()/write().
+/// Throw std::runtime_error on errors (dst must not exist).
+CopyMethod copyFileAt(int srcDirFd, const std::string& src, int dstDirFd, const std::string& dst);
+#endif
+
+/// Read-only view of the contents of a whole file.
+///
+/// Regular files are memory mapped (with sequential access advice), so scanning
+/// them does not allocate or copy anything. Pipes, special files and files which
+/// cannot be mapped are read into memory using read(). Files truncated while they
+/// are mapped do not crash the process (see wasTruncated()).
+class MappedFile
+{
+public:
+    MappedFile() = default;
+
+    /// Open and map/read file.
+    explicit MappedFile(const std::string& filename);
+
+#ifndef _WIN32
+    /// Open and map/read file relative to directory file descriptor dirFd (openat()).
+    /// Throw std::system_error with errno if the file cannot be opened.
+    MappedFile(int dirFd, const std::string& filename);
+#endif
+
+    ~MappedFile();
+
+    /// Create from data which is already in memory.
+    static MappedFile fromBuffer(std::string data)
+    {
+        MappedFile file;
+        file.buffer = std::move(data);
+        return file;
+    }
+
+    MappedFile(const MappedFile&)            = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    /// Get file contents.
+    std::string_view view() const noexcept { return mapped ? std::string_view(mapData, mapSize) : std::string_view(buffer); }
+
+    /// Get file size.
+    size_t size() const noexcept { return view().size(); }
+
+    /// Return true iff the file is memory mapped (and not read into memory).
+    bool isMapped() const noexcept { return mapped; }
+
+    /// Read all pages of a mapped file into memory now, so later accesses do not wait for I/O.
+    void prefault() const noexcept;
+
+    /// Release the memory of the pages of a mapped file before offset end (they are read again when accessed), so scanning huge files does not fill the memory.
+    void discard(size_t end) noexcept;
+
+    /// Return true iff the mapped file was found to be truncated (by another process) while it was read.
+    /// Reading beyond the end of a mapped file raises SIGBUS, so mapped files are guarded: The missing part reads as zero bytes instead.
+    /// Check this after reading the contents and discard everything derived from them if true.
+    bool wasTruncated() const noexcept;
+
+    /// Unmap file or free buffer.
+    void close() noexcept;
+
+private:
+    const char* mapData{};
+    size_t      mapSize{};
+    bool        mapped{};
+    size_t      discardedSize{};
+    int         guard{-1}; ///< SIGBUS guard of the mapping.
+    std::string buffer;
+};
 
 /// Get file size.
 size_t getFileSize(const std::string& filename);
@@ -313,6 +476,16 @@ public:
 #endif
     }
 
+    struct timespec getCTimeSpec() const
+    {
+#ifdef __linux__
+        return statData.st_ctim;
+#endif
+#ifdef __APPLE__
+        return statData.st_ctimespec;
+#endif
+    }
+
     struct stat statData;
 };
 
@@ -325,6 +498,10 @@ std::filesystem::file_time_type getLastWriteTime(const std::filesystem::director
 /// Set last write time (as in std::filesystem::last_write_time()).
 void setLastWriteTime(const std::filesystem::directory_entry& entry, std::filesystem::file_time_type new_time, bool followSymlinks = true);
 
+/// Raise the limit of open files of this process (the soft limit RLIMIT_NOFILE) up to maxLimit if the hard limit allows it.
+/// Return the resulting limit (at most maxLimit).
+size_t raiseOpenFileLimit(size_t maxLimit);
+
 // --- Misc ---
 
 /// Get current absolute wallclock time in seconds.
@@ -0,0 +1,243 @@
+// Persistent cache of files which are known to contain no match.
+//
+// Copyright (c) 2026 Johannes Overmann
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#include "NoMatchCache.hpp"
+#include "UnitTest.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+namespace ut1
+{
+
+NoMatchCache::NoMatchCache(std::string filename_, uint64_t rulesHash_, size_t maxSize_)
+: filename(std::move(filename_))
+, rulesHash(rulesHash_)
+, maxSize(maxSize_)
+, openTimeNs(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count())
+{
+    try
+    {
+        file = MappedFile(filename);
+    }
+    catch (const std::runtime_error&)
+    {
+        // No cache file yet.
+    }
+    entries = getEntries(file);
+}
+
+
+NoMatchCache::Key NoMatchCache::getKey(uint64_t dev, uint64_t ino, uint64_t size, int64_t mtimeNs, int64_t ctimeNs) const noexcept
+{
+    std::array<uint64_t, 3> id{rulesHash, dev, ino};
+    return {hash(std::string_view(reinterpret_cast<const char*>(id.data()), sizeof(id))), size, mtimeNs, ctimeNs};
+}
+
+
+NoMatchCache::Key NoMatchCache::getKey(const StatInfo& info) const noexcept
+{
+    struct timespec mtime = info.getMTimeSpec();
+    struct timespec ctime = info.getCTimeSpec();
+    return getKey(uint64_t(info.getDev()), uint64_t(info.getIno()), uint64_t(info.statData.st_size), int64_t(mtime.tv_sec) * 1000000000 + mtime.tv_nsec, int64_t(ctime.tv_sec) * 1000000000 + ctime.tv_nsec);
+}
+
+
+bool NoMatchCache::contains(const Key& key)
+{
+    const Entry* entry = find(entries, key.id);
+    if (!entry || (entry->key.size != key.size) || (entry->key.mtimeNs != key.mtimeNs) || (entry->key.ctimeNs != key.ctimeNs))
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    found.insert(key.id);
+    return true;
+}
+
+
+void NoMatchCache::add(const Key& key)
+{
+    if (std::max(key.mtimeNs, key.ctimeNs) >= openTimeNs - kRacyTimeNs)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    added[key.id] = {key, openTimeNs / 1000000000};
+}
+
+
+void NoMatchCache::save()
+{
+    std::vector<Entry> merged;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (added.empty())
+        {
+            return;
+        }
+
+        // Merge into the current cache file, which may have been saved by another process since it was opened.
+        // Entries which were found are refreshed, so they are dropped last.
+        MappedFile current;
+        try
+        {
+            current = MappedFile(filename);
+        }
+        catch (const std::runtime_error&)
+        {
+        }
+        for (const Entry& entry: getEntries(current))
+        {
+            if (!added.contains(entry.key.id))
+            {
+                merged.push_back(entry);
+                if (found.contains(entry.key.id))
+                {
+                    merged.back().addedSec = openTimeNs / 1000000000;
+                }
+            }
+        }
+        for (const auto& [id, entry]: added)
+        {
+            merged.push_back(entry);
+        }
+        added.clear();
+    }
+
+    // Drop the oldest entries.
+    size_t maxEntries = (maxSize > sizeof(Header)) ? (maxSize - sizeof(Header)) / sizeof(Entry) : 0;
+    if (merged.size() > maxEntries)
+    {
+        std::nth_element(merged.begin(), merged.begin() + maxEntries, merged.end(), [](const Entry& a, const Entry& b) { return a.addedSec > b.addedSec; });
+        merged.resize(maxEntries);
+    }
+    std::sort(merged.begin(), merged.end(), [](const Entry& a, const Entry& b) { return a.key.id < b.key.id; });
+
+    Header header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.numEntries = merged.size();
+    std::string data(reinterpret_cast<const char*>(&header), sizeof(header));
+    data.append(reinterpret_cast<const char*>(merged.data()), merged.size() * sizeof(Entry));
+
+    std::filesystem::path path(filename);
+    std::error_code       ec;
+    if (path.has_parent_path())
+    {
+        std::filesystem::create_directories(path.parent_path(), ec);
+    }
+    std::string tempName = std::format("{}.{}.tmp", filename, openTimeNs);
+    writeFile(tempName, data);
+    std::filesystem::rename(tempName, filename, ec);
+    if (ec)
+    {
+        std::filesystem::remove(tempName, ec);
+        throw std::runtime_error(std::format("Cannot write cache file {}: {}.", filename, ec.message()));
+    }
+}
+
+
+uint64_t NoMatchCache::hash(std::string_view data, uint64_t h) noexcept
+{
+    for (char c: data)
+    {
+        h = (h ^ uint8_t(c)) * 0x100000001b3;
+    }
+    return h;
+}
+
+
+std::span<const NoMatchCache::Entry> NoMatchCache::getEntries(const MappedFile& file) noexcept
+{
+    // Only mapped files are suitably aligned.
+    std::string_view data = file.view();
+    if (!file.isMapped() || (data.size() < sizeof(Header)))
+    {
+        return {};
+    }
+    const Header* header = reinterpret_cast<const Header*>(data.data());
+    if ((std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0) || (header->numEntries != (data.size() - sizeof(Header)) / sizeof(Entry)) ||
+        ((data.size() - sizeof(Header)) % sizeof(Entry) != 0))
+    {
+        return {};
+    }
+    return {reinterpret_cast<const Entry*>(data.data() + sizeof(Header)), size_t(header->numEntries)};
+}
+
+
+const NoMatchCache::Entry* NoMatchCache::find(std::span<const Entry> entries, uint64_t id) noexcept
+{
+    auto it = std::lower_bound(entries.begin(), entries.end(), id, [](const Entry& entry, uint64_t value) { return entry.key.id < value; });
+    return ((it != entries.end()) && (it->key.id == id)) ? &*it : nullptr;
+}
+
+
+UNIT_TEST(NoMatchCache)
+{
+    ASSERT_EQ(NoMatchCache::hash(""), uint64_t(0xcbf29ce484222325));
+    ASSERT_EQ(NoMatchCache::hash("a"), uint64_t(0xaf63dc4c8601ec8c));
+
+    std::filesystem::path dir = "NoMatchCacheTmp";
+    std::filesystem::remove_all(dir);
+    std::string filename = (dir / "sub" / "cache").string();
+    {
+        NoMatchCache      cache(filename, 1, 1000);
+        NoMatchCache::Key key = cache.getKey(2, 3, 4, 5, 6);
+        ASSERT_EQ(cache.contains(key), false);
+        cache.add(key);
+        cache.add(cache.getKey(2, 4, 4, 5, std::numeric_limits<int64_t>::max())); // Changed just now: Not recorded.
+        cache.save();
+    }
+    {
+        NoMatchCache cache(filename, 1, 1000);
+        ASSERT_EQ(cache.contains(cache.getKey(2, 3, 4, 5, 6)), true);
+        ASSERT_EQ(cache.contains(cache.getKey(2, 3, 5, 5, 6)), false);
+        ASSERT_EQ(cache.contains(cache.getKey(2, 3, 4, 7, 6)), false);
+        ASSERT_EQ(cache.contains(cache.getKey(2, 3, 4, 5, 7)), false);
+        ASSERT_EQ(cache.contains(cache.getKey(2, 4, 4, 5, 6)), false);
+        ASSERT_EQ(cache.contains(cache.getKey(2, 4, 4, 5, std::numeric_limits<int64_t>::max())), false);
+        NoMatchCache otherRules(filename, 2, 1000);
+        ASSERT_EQ(otherRules.contains(otherRules.getKey(2, 3, 4, 5, 6)), false);
+
+        // Nothing new: The file is not written.
+        std::filesystem::file_time_type mtime = std::filesystem::last_write_time(filename);
+        cache.save();
+        ASSERT_EQ(std::filesystem::last_write_time(filename) == mtime, true);
+    }
+
+    // Size limit.
+    {
+        NoMatchCache cache(filename, 1, 100);
+        for (uint64_t ino = 10; ino < 15; ino++)
+        {
+            cache.add(cache.getKey(2, ino, 4, 5, 6));
+        }
+        cache.save();
+    }
+    ASSERT_EQ(std::filesystem::file_size(filename) <= 100, true);
+    ASSERT_EQ(std::filesystem::file_size(filename) > 50, true);
+
+    // Invalid cache files are empty.
+    writeFile(filename, "garbage");
+    {
+        NoMatchCache cache(filename, 1, 1000);
+        ASSERT_EQ(cache.contains(cache.getKey(2, 3, 4, 5, 6)), false);
+        cache.add(cache.getKey(2, 3, 4, 5, 6));
+        cache.save();
+        ASSERT_EQ(NoMatchCache(filename, 1, 1000).contains(cache.getKey(2, 3, 4, 5, 6)), true);
+    }
+    ASSERT_EQ(std::distance(std::filesystem::directory_iterator(dir / "sub"), std::filesystem::directory_iterator()), 1);
+    std::filesystem::remove_all(dir);
+}
+
+} // namespace ut1
@@ -0,0 +1,103 @@
+// Persistent cache of files which are known to contain no match.
+//
+// Copyright (c) 2026 Johannes Overmann
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include "MiscUtils.hpp"
+
+namespace ut1
+{
+
+/// Persistent cache of files which are known to contain no match for a set of rules (identified by a hash of the rules).
+///
+/// The cache file is a header followed by fixed-size entries sorted by id. It is memory mapped, so a lookup is a binary search
+/// which only touches a few pages. Files are identified by device and inode and are unchanged if size, mtime and ctime are unchanged.
+/// New entries are collected in memory and merged into the cache file by save(). Thread-safe.
+class NoMatchCache
+{
+public:
+    /// Identity and version of a file.
+    struct Key
+    {
+        uint64_t id{}; ///< Hash of the rules hash, the device and the inode.
+        uint64_t size{};
+        int64_t  mtimeNs{};
+        int64_t  ctimeNs{};
+    };
+
+    /// Constructor. Map cache file filename_ (a missing or invalid file is an empty cache).
+    /// save() keeps at most maxSize_ bytes (the oldest entries are dropped).
+    NoMatchCache(std::string filename_, uint64_t rulesHash_, size_t maxSize_);
+
+    NoMatchCache(const NoMatchCache&)            = delete;
+    NoMatchCache& operator=(const NoMatchCache&) = delete;
+
+    /// Get key of a file.
+    Key getKey(uint64_t dev, uint64_t ino, uint64_t size, int64_t mtimeNs, int64_t ctimeNs) const noexcept;
+
+    /// Get key of a file from its stat() info.
+    Key getKey(const StatInfo& info) const noexcept;
+
+    /// Return true iff the file with key is known to contain no match.
+    bool contains(const Key& key);
+
+    /// Record that the file with key contains no match.
+    /// Files modified less than kRacyTime before the cache was opened are not recorded: A later modification might not change mtime/ctime then.
+    void add(const Key& key);
+    static constexpr int64_t kRacyTimeNs = 1000000000;
+
+    /// Merge the new entries into the cache file and write it atomically (temporary file and rename()).
+    /// Nothing is written if there are no new entries. Throw std::runtime_error on errors.
+    void save();
+
+    /// Get 64 bit FNV-1a hash of data (continuing hash h).
+    static uint64_t hash(std::string_view data, uint64_t h = 0xcbf29ce484222325) noexcept;
+
+private:
+    /// Cache file entry.
+    struct Entry
+    {
+        Key     key;
+        int64_t addedSec{}; ///< When the entry was added or last found (seconds since the epoch).
+    };
+
+    /// Cache file header.
+    struct Header
+    {
+        char     magic[8];
+        uint64_t numEntries;
+    };
+    static constexpr char kMagic[8] = {'S', 'T', 'R', 'N', 'M', 'C', '0', '1'};
+
+    /// Get the entries of the cache file file (empty if it is invalid).
+    static std::span<const Entry> getEntries(const MappedFile& file) noexcept;
+
+    /// Find entry for id in entries (sorted by id), or nullptr.
+    static const Entry* find(std::span<const Entry> entries, uint64_t id) noexcept;
+
+    std::string filename;
+    uint64_t    rulesHash;
+    size_t      maxSize;
+    int64_t     openTimeNs;
+
+    MappedFile             file;
+    std::span<const Entry> entries;
+
+    /// Protects the members below.
+    std::mutex                          mutex;
+    std::unordered_map<uint64_t, Entry> added;
+    std::unordered_set<uint64_t>        found;
+};
+
+} // namespace ut1
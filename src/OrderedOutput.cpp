@@ -0,0 +1,97 @@
+// Deterministically ordered output of concurrently produced text.
+//
+// Copyright (c) 2026 Johannes Overmann
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#include "OrderedOutput.hpp"
+#include "MiscUtils.hpp"
+#include "UnitTest.hpp"
+
+namespace ut1
+{
+
+OrderedOutput::SlotPtr OrderedOutput::createSlot(const SlotPtr& parent)
+{
+    SlotPtr                     slot = std::make_shared<Slot>();
+    std::lock_guard<std::mutex> lock(mutex);
+    (parent ? *parent : root).children.push_back(slot);
+    return slot;
+}
+
+
+void OrderedOutput::finish(const SlotPtr& slot)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    slot->finished = true;
+    flush(root);
+}
+
+
+bool OrderedOutput::flush(Slot& slot)
+{
+    if (!slot.finished)
+    {
+        return false;
+    }
+    if (!slot.printed)
+    {
+        std::string text = slot.out.str();
+        if (!text.empty())
+        {
+            out << text << std::flush;
+        }
+        text = slot.err.str();
+        if (!text.empty())
+        {
+            err << text << std::flush;
+        }
+        slot.out.str(std::string());
+        slot.err.str(std::string());
+        slot.printed = true;
+    }
+    while (!slot.children.empty())
+    {
+        if (!flush(*slot.children.front()))
+        {
+            return false;
+        }
+        slot.children.pop_front();
+    }
+    return true;
+}
+
+
+UNIT_TEST(OrderedOutput)
+{
+    std::ostringstream os;
+    std::ostringstream es;
+    OrderedOutput      output(os, es);
+
+    OrderedOutput::SlotPtr a  = output.createSlot();
+    OrderedOutput::SlotPtr b  = output.createSlot();
+    OrderedOutput::SlotPtr a1 = output.createSlot(a);
+    OrderedOutput::SlotPtr a2 = output.createSlot(a);
+    a->out << "a ";
+    a1->out << "a1 ";
+    a2->out << "a2 ";
+    a2->err << "e2 ";
+    b->out << "b ";
+
+    output.finish(b);
+    output.finish(a2);
+    ASSERT_EQ(os.str(), std::string());
+    output.finish(a);
+    ASSERT_EQ(os.str(), std::string("a "));
+    output.finish(a1);
+    ASSERT_EQ(os.str(), std::string("a a1 a2 b "));
+    ASSERT_EQ(es.str(), std::string("e2 "));
+
+    OrderedOutput::SlotPtr c = output.createSlot();
+    c->out << "c";
+    output.finish(c);
+    ASSERT_EQ(os.str(), std::string("a a1 a2 b c"));
+}
+
+} // namespace ut1
@@ -0,0 +1,68 @@
+// Deterministically ordered output of concurrently produced text.
+//
+// Copyright (c) 2026 Johannes Overmann
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <iostream>
+#include <sstream>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+namespace ut1
+{
+
+/// Output which is written in an order defined by a tree of slots, independent of the order in which the slots are completed.
+///
+/// Each slot collects the text for stdout and stderr of one unit of work.
+/// A slot is printed after its parent slot and after all previously created children of its parent (including their children).
+/// The text of a slot is printed as soon as the slot and all slots which precede it are finished.
+class OrderedOutput
+{
+public:
+    /// Output slot.
+    class Slot
+    {
+    public:
+        /// Text for stdout and stderr.
+        /// Only accessed by the single thread owning the slot until the slot is finished.
+        std::ostringstream out;
+        std::ostringstream err;
+
+    private:
+        friend class OrderedOutput;
+        std::deque<std::shared_ptr<Slot>> children;
+        bool                              finished{};
+        bool                              printed{};
+    };
+    using SlotPtr = std::shared_ptr<Slot>;
+
+    /// Constructor.
+    explicit OrderedOutput(std::ostream& out_ = std::cout, std::ostream& err_ = std::cerr): out(out_), err(err_) { root.finished = true; }
+
+    /// Create slot as the last child of parent (or as the last top level slot if parent is nullptr).
+    /// Parent must not be finished yet.
+    SlotPtr createSlot(const SlotPtr& parent = nullptr);
+
+    /// Mark slot as finished: No more text is written to the slot and no more children are created.
+    /// Print all text which is ready to be printed. Finishing a slot again has no effect.
+    void finish(const SlotPtr& slot);
+
+private:
+    /// Print all text of slot and its children which is ready to be printed.
+    /// Return true iff slot and all its children are printed completely.
+    bool flush(Slot& slot);
+
+    std::ostream& out;
+    std::ostream& err;
+
+    /// Protects the tree structure and the finished flags.
+    std::mutex mutex;
+    Slot       root;
+};
+
+} // namespace ut1
@@ -0,0 +1,135 @@
+// Pre-parsed replacement format strings.
+//
+// Copyright (c) 2026 Johannes Overmann
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#include "ReplacementTemplate.hpp"
+#include "MiscUtils.hpp"
+#include "UnitTest.hpp"
+#include <regex>
+
+namespace ut1
+{
+
+ReplacementTemplate::ReplacementTemplate(const std::string& fmt_, const std::string& dollar)
+{
+    // Translate a custom substitution string into '$' (and literal '$' into "$$").
+    std::string fmt = fmt_;
+    if (dollar != "$")
+    {
+        replaceStringInPlace(fmt, "$", "$$");
+        replaceStringInPlace(fmt, dollar, "$");
+    }
+
+    auto addSegment = [&](Segment::Type type, size_t group = 0)
+    {
+        Segment segment;
+        segment.type   = type;
+        segment.offset = group;
+        segments.push_back(segment);
+    };
+    for (size_t i = 0; i < fmt.size(); i++)
+    {
+        if ((fmt[i] != '$') || (i + 1 == fmt.size()))
+        {
+            appendLiteral(std::string_view(fmt).substr(i, 1));
+            continue;
+        }
+        char c = fmt[++i];
+        if (c == '$')
+        {
+            appendLiteral("$");
+        }
+        else if (c == '&')
+        {
+            addSegment(Segment::Type::GROUP, 0);
+        }
+        else if (c == '`')
+        {
+            addSegment(Segment::Type::PREFIX);
+        }
+        else if (c == '\'')
+        {
+            addSegment(Segment::Type::SUFFIX);
+        }
+        else if (std::isdigit(static_cast<unsigned char>(c)))
+        {
+            // $n and $nn.
+            size_t group = size_t(c - '0');
+            if ((i + 1 < fmt.size()) && std::isdigit(static_cast<unsigned char>(fmt[i + 1])))
+            {
+                group = group * 10 + size_t(fmt[++i] - '0');
+            }
+            addSegment(Segment::Type::GROUP, group);
+        }
+        else
+        {
+            appendLiteral(std::string_view(fmt).substr(i - 1, 2));
+        }
+    }
+}
+
+
+void ReplacementTemplate::appendLiteral(std::string_view s)
+{
+    if (segments.empty() || (segments.back().type != Segment::Type::LITERAL))
+    {
+        Segment segment;
+        segment.type   = Segment::Type::LITERAL;
+        segment.offset = literals.size();
+        segments.push_back(segment);
+    }
+    literals.append(s);
+    segments.back().length += s.size();
+}
+
+
+void ReplacementTemplate::expand(std::string& out, std::string_view s, size_t prefixPos, const std::vector<size_t>& caps) const
+{
+    expand(out, s, prefixPos, caps[0], caps[1], [&](size_t group)
+        {
+            if ((group * 2 + 1 < caps.size()) && (caps[group * 2] != std::string::npos) && (caps[group * 2 + 1] != std::string::npos))
+            {
+                return s.substr(caps[group * 2], caps[group * 2 + 1] - caps[group * 2]);
+            }
+            return std::string_view();
+        });
+}
+
+
+UNIT_TEST(ReplacementTemplate)
+{
+    // Compare against std::match_results::format() for all matches.
+    const std::string s = "foo=12 bar=345 baz";
+    std::regex        re("([a-z]+)=(\\d)(\\d)?");
+    for (const char* fmt: {"", "x", "$&", "$1:$2$3", "$$1", "$`|$'", "$0$00$01$1x$10$9", "$", "a$", "$x$-", "<$2$>", "$$$&"})
+    {
+        ReplacementTemplate replacement(fmt);
+        size_t              prefixPos = 0;
+        for (std::sregex_iterator it(s.begin(), s.end(), re), end; it != end; it++)
+        {
+            std::string r;
+            size_t      pos = size_t(it->position(0));
+            replacement.expand(r, s, prefixPos, pos, pos + size_t(it->length(0)), [&](size_t group)
+                { return ((group < it->size()) && (*it)[group].matched) ? std::string_view(s).substr(size_t(it->position(group)), size_t(it->length(group))) : std::string_view(); });
+            ASSERT_EQ(r, it->format(fmt));
+            prefixPos = pos + size_t(it->length(0));
+        }
+    }
+
+    // Custom substitution string.
+    std::string r;
+    ReplacementTemplate("$SUB1-SUB&-SUBSUB", "SUB").expand(r, "abc", 0, {1, 2, 1, 2});
+    ASSERT_EQ(r, std::string("$b-b-$"));
+    ASSERT_EQ(ReplacementTemplate("x$y").isLiteral(), true);
+    ASSERT_EQ(ReplacementTemplate("x$y").getLiterals(), std::string("x$y"));
+    ASSERT_EQ(ReplacementTemplate("x$1").isLiteral(), false);
+    ASSERT_EQ(ReplacementTemplate("").isLiteral(), true);
+    ASSERT_EQ(ReplacementTemplate("x$1$&").usesContext(), false);
+    ASSERT_EQ(ReplacementTemplate("x$`").usesContext(), true);
+    ASSERT_EQ(ReplacementTemplate("$'").usesContext(), true);
+}
+
+} // namespace ut1
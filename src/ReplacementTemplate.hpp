@@ -0,0 +1,86 @@
+// Pre-parsed replacement format strings.
+//
+// Copyright (c) 2026 Johannes Overmann
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ut1
+{
+
+/// Replacement format string, parsed once and expanded for each match.
+///
+/// The syntax is the one of std::match_results::format() (ECMAScript):
+/// $$, $&, $`, $', $n and $nn. Any other $x is copied verbatim.
+class ReplacementTemplate
+{
+public:
+    /// Constructor.
+    /// Occurrences of dollar in fmt are the substitution character (instead of '$', which is then a literal char).
+    explicit ReplacementTemplate(const std::string& fmt = std::string(), const std::string& dollar = "$");
+
+    /// Append replacement for the match s[matchStart, matchEnd) to out.
+    /// The prefix ($`) starts at prefixPos (the end of the previous match) and the suffix ($') extends to the end of s.
+    /// group(n) must return the string of group n (or an empty string if group n did not participate in the match or does not exist).
+    template<typename Group>
+    void expand(std::string& out, std::string_view s, size_t prefixPos, size_t matchStart, size_t matchEnd, Group group) const
+    {
+        for (const Segment& segment: segments)
+        {
+            switch (segment.type)
+            {
+            case Segment::Type::LITERAL: out.append(literals, segment.offset, segment.length); break;
+            case Segment::Type::GROUP: out.append(group(segment.offset)); break;
+            case Segment::Type::PREFIX: out.append(s.substr(prefixPos, matchStart - prefixPos)); break;
+            case Segment::Type::SUFFIX: out.append(s.substr(matchEnd)); break;
+            }
+        }
+    }
+
+    /// Append replacement for the match described by caps to out.
+    /// caps contains start/end positions of all groups including group 0 (npos for unmatched groups).
+    void expand(std::string& out, std::string_view s, size_t prefixPos, const std::vector<size_t>& caps) const;
+
+    /// Return true iff the replacement does not depend on the match.
+    bool isLiteral() const noexcept { return (segments.size() <= 1) && ((segments.empty()) || (segments[0].type == Segment::Type::LITERAL)); }
+
+    /// Return true iff the replacement contains the prefix ($`) or the suffix ($') of the match, which depend on the text around the match.
+    bool usesContext() const noexcept
+    {
+        return std::any_of(segments.begin(), segments.end(), [](const Segment& segment) { return (segment.type == Segment::Type::PREFIX) || (segment.type == Segment::Type::SUFFIX); });
+    }
+
+    /// Get the replacement if it does not depend on the match (see isLiteral()).
+    const std::string& getLiterals() const noexcept { return literals; }
+
+private:
+    /// Template segment.
+    struct Segment
+    {
+        enum class Type { LITERAL, GROUP, PREFIX, SUFFIX };
+        Type type{};
+
+        /// LITERAL: Offset into literals. GROUP: Group index.
+        size_t offset{};
+
+        /// LITERAL: Length.
+        size_t length{};
+    };
+
+    /// Append literal chars to the template.
+    void appendLiteral(std::string_view s);
+
+    std::vector<Segment> segments;
+
+    /// Literal chars of all LITERAL segments.
+    std::string literals;
+};
+
+} // namespace ut1
@@ -0,0 +1,245 @@
+// Work-stealing thread pool.
+//
+// Copyright (c) 2026 Johannes Overmann
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#include "ThreadPool.hpp"
+#include "MiscUtils.hpp"
+#include "UnitTest.hpp"
+#include <stdexcept>
+
+namespace ut1
+{
+
+/// Pool and worker index of the current thread (nullptr for non-worker threads).
+static thread_local const ThreadPool* currentPool{};
+static thread_local unsigned          currentWorker{};
+
+
+ThreadPool::ThreadPool(unsigned numThreads)
+{
+    numThreads = std::max(numThreads, 1u);
+    for (unsigned i = 0; i < numThreads; i++)
+    {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for (unsigned i = 0; i < numThreads; i++)
+    {
+        threads.emplace_back([this, i]() { run(i); });
+    }
+}
+
+
+ThreadPool::~ThreadPool()
+{
+    failed = true;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    workAvailable.notify_all();
+    for (std::thread& thread: threads)
+    {
+        thread.join();
+    }
+}
+
+
+void ThreadPool::submit(Task task)
+{
+    if (failed)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (exception)
+        {
+            std::rethrow_exception(exception);
+        }
+        return; // Pool is being destroyed.
+    }
+    unsigned index = (currentPool == this) ? currentWorker : (nextQueue++ % getNumThreads());
+
+    // Count the task before it becomes visible: Otherwise it may be stolen and finished before it is counted,
+    // so the counters underflow and wait() returns while tasks are still running.
+    numPending++;
+    numQueued++;
+    {
+        std::lock_guard<std::mutex> queueLock(queues[index]->mutex);
+        queues[index]->tasks.push_back(std::move(task));
+    }
+
+    // A worker increments numWaiting before it checks numQueued, so either it sees the task or it is woken up here.
+    // Taking the mutex makes sure that it is not between checking numQueued and waiting.
+    if (numWaiting > 0)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+        }
+        workAvailable.notify_one();
+    }
+}
+
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    allDone.wait(lock, [this]() { return numPending == 0; });
+    if (exception)
+    {
+        std::exception_ptr e = exception;
+        exception            = nullptr;
+        failed               = false;
+        std::rethrow_exception(e);
+    }
+}
+
+
+bool ThreadPool::getTask(unsigned index, Task& task)
+{
+    // Own queue: Oldest task first.
+    {
+        Queue&                      queue = *queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty())
+        {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            return true;
+        }
+    }
+
+    // Steal newest task from other queues.
+    for (unsigned i = 1; i < getNumThreads(); i++)
+    {
+        Queue&                      queue = *queues[(index + i) % getNumThreads()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty())
+        {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+
+void ThreadPool::run(unsigned index)
+{
+    currentPool   = this;
+    currentWorker = index;
+    while (true)
+    {
+        Task task;
+        if (!getTask(index, task))
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            numWaiting++;
+            workAvailable.wait(lock, [this]() { return stopping || (numQueued > 0); });
+            numWaiting--;
+            if (stopping && (numQueued == 0))
+            {
+                return;
+            }
+            continue;
+        }
+        numQueued--;
+
+        if (!failed)
+        {
+            try
+            {
+                task(index);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!exception)
+                {
+                    exception = std::current_exception();
+                }
+                failed = true;
+            }
+        }
+        task = nullptr;
+
+        if (--numPending == 0)
+        {
+            // wait() checks numPending with the mutex held, so it cannot miss this notification.
+            std::lock_guard<std::mutex> lock(mutex);
+            allDone.notify_all();
+        }
+    }
+}
+
+
+UNIT_TEST(ThreadPool)
+{
+    // Tasks submitting more tasks.
+    ThreadPool            pool(4);
+    std::atomic<unsigned> sum{};
+    std::atomic<bool>     badIndex{};
+    for (unsigned i = 0; i < 100; i++)
+    {
+        pool.submit([&, i](unsigned worker)
+            {
+                badIndex = badIndex || (worker >= 4);
+                sum += i;
+                pool.submit([&](unsigned) { sum += 1000; });
+            });
+    }
+    pool.wait();
+    ASSERT_EQ(unsigned(sum), 4950u + 100000u);
+    ASSERT_EQ(bool(badIndex), false);
+
+    // Exceptions.
+    bool thrown = false;
+    pool.submit([](unsigned) { throw std::runtime_error("test"); });
+    try
+    {
+        pool.wait();
+    }
+    catch (const std::runtime_error&)
+    {
+        thrown = true;
+    }
+    ASSERT_EQ(thrown, true);
+
+    // The pool is usable again after wait().
+    pool.submit([&](unsigned) { sum = 1; });
+    pool.wait();
+    ASSERT_EQ(unsigned(sum), 1u);
+}
+
+
+UNIT_TEST(ThreadPool_nestedSubmitStress)
+{
+    // Trees of nested submits: wait() must not return before all of them are done.
+    ThreadPool            pool(8);
+    std::atomic<unsigned> numDone{};
+    std::function<void(unsigned)> submitTree = [&](unsigned depth)
+    {
+        pool.submit([&, depth](unsigned)
+            {
+                if (depth > 0)
+                {
+                    submitTree(depth - 1);
+                    submitTree(depth - 1);
+                }
+                numDone++;
+            });
+    };
+    bool early = false;
+    for (unsigned round = 0; round < 200; round++)
+    {
+        numDone = 0;
+        submitTree(6);
+        submitTree(3);
+        pool.wait();
+        early = early || (numDone != 127u + 15u);
+    }
+    ASSERT_EQ(early, false);
+}
+
+} // namespace ut1
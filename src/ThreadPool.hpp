@@ -0,0 +1,92 @@
+// Work-stealing thread pool.
+//
+// Copyright (c) 2026 Johannes Overmann
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <functional>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+
+namespace ut1
+{
+
+/// Thread pool with one task queue per worker thread.
+///
+/// Each worker takes tasks from the front of its own queue (so tasks are
+/// started roughly in submission order) and steals tasks from the back of the
+/// queues of other workers when its own queue is empty. Tasks submitted from a
+/// worker thread go to the queue of that worker, tasks submitted from other
+/// threads are distributed round-robin.
+///
+/// If a task throws, all tasks which have not been started yet are skipped and
+/// the exception is rethrown by wait() (and by submit()).
+class ThreadPool
+{
+public:
+    /// Task. The argument is the index of the worker thread running the task (0..getNumThreads()-1).
+    using Task = std::function<void(unsigned)>;
+
+    /// Constructor. Start numThreads worker threads (at least one).
+    explicit ThreadPool(unsigned numThreads);
+
+    /// Destructor. Skip all remaining tasks and join all threads.
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&)            = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /// Submit task.
+    /// Rethrow the exception of a failed task (and do not submit the task) if a task failed.
+    void submit(Task task);
+
+    /// Wait until all tasks (including tasks submitted by tasks) are done.
+    /// Rethrow the exception of the first failed task.
+    /// Must not be called from a worker thread.
+    void wait();
+
+    /// Get number of worker threads.
+    unsigned getNumThreads() const noexcept { return unsigned(queues.size()); }
+
+private:
+    /// Task queue of one worker.
+    struct Queue
+    {
+        std::mutex       mutex;
+        std::deque<Task> tasks;
+    };
+
+    /// Worker thread main function.
+    void run(unsigned index);
+
+    /// Get task from own queue or steal task from another queue.
+    bool getTask(unsigned index, Task& task);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread>            threads;
+    std::atomic<unsigned>               nextQueue{};
+
+    /// Task counters. They are counted before a task is queued, so they never underflow.
+    std::atomic<size_t>   numQueued{};  ///< Tasks in the queues.
+    std::atomic<size_t>   numPending{}; ///< Tasks in the queues or running.
+    std::atomic<unsigned> numWaiting{}; ///< Workers waiting for workAvailable (submit() only wakes workers if there are any).
+    std::atomic<bool>     failed{};
+
+    /// Protects the members below. Only taken to wait and to wake up waiting threads, not for each task.
+    std::mutex              mutex;
+    std::condition_variable workAvailable;
+    std::condition_variable allDone;
+    bool                    stopping{};
+    std::exception_ptr      exception;
+};
+
+} // namespace ut1
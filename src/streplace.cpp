@@ -6,12 +6,33 @@
 // (See accompanying file LICENSE or copy at https://www.boost.org/LICENSE_1_0.txt)
 
 #include <regex>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <filesystem>
 #include <set>
 #include <utility>
+#include <optional>
+#include <algorithm>
+#include <array>
+#include <thread>
+#include <atomic>
+#include <deque>
+#include <future>
+#include <chrono>
+#include <system_error>
 #include "CommandLineParser.hpp"
 #include "MiscUtils.hpp"
+#include "LiteralSearch.hpp"
+#include "AhoCorasick.hpp"
+#include "DfaRegex.hpp"
+#include "ReplacementTemplate.hpp"
+#include "ThreadPool.hpp"
+#include "FileReader.hpp"
+#include "FileWriter.hpp"
+#include "NoMatchCache.hpp"
+#include "OrderedOutput.hpp"
+#include "DirEntry.hpp"
 #include "UnitTest.hpp"
 
 /// Escape sequences used for verbose output/tracing.
@@ -43,7 +64,7 @@ Error::~Error() { }
 class Rule
 {
 public:
-    Rule(const std::string& rule, const std::string& separator, bool noRegex)
+    Rule(const std::string& rule, const std::string& separator, const std::string& dollar, bool noRegex, bool useDfa, std::regex::flag_type regexFlags)
     {
         std::vector<std::string> sides = ut1::splitString(rule, separator);
         if (sides.size() != 2)
@@ -52,14 +73,100 @@ public:
         }
         lhs = std::move(sides[0]);
         rhs = ut1::compileCString(sides[1]);
+        replacement = ut1::ReplacementTemplate(rhs, dollar);
         if (noRegex)
         {
+            if (!lhs.empty())
+            {
+                // Literal rules use a dedicated substring searcher instead of a regex.
+                literal.emplace(lhs, (regexFlags & std::regex::icase) != 0);
+                return;
+            }
             lhs = ut1::quoteRegexChars(lhs);
         }
+
+        // --engine=dfa: Use the linear-time engine if it supports the regex, else fall back to std::regex.
+        if (useDfa)
+        {
+            try
+            {
+                dfa.emplace(lhs, (regexFlags & std::regex::icase) != 0);
+                numRegexesCompiled++;
+                return;
+            }
+            catch (const ut1::DfaRegex::Unsupported& e)
+            {
+                fallbackReason = e.what();
+            }
+        }
+
+        // Compile the regex once here. It is reused for all files, filenames and symlinks.
+        try
+        {
+            regex = std::regex(lhs, regexFlags);
+            numRegexesCompiled++;
+        }
+        catch (const std::regex_error& e)
+        {
+            throw Error("Invalid regex \"" + lhs + "\" in rule \"" + rule + "\": " + e.what());
+        }
+    }
+
+    /// Number of regexes compiled by all rules (std::regex or DfaRegex), for -vv.
+    static inline std::atomic<uint64_t> numRegexesCompiled{};
+
+    /// Return true iff this rule is matched by the literal searcher (and not by a regex).
+    bool isLiteral() const { return literal.has_value(); }
+
+    /// Return true iff this rule is matched by the DFA engine.
+    bool isDfa() const { return dfa.has_value(); }
+
+    /// Return true iff applying this rule to the lines of a string separately gives the same result as applying it to the whole string:
+    /// Matches never contain a newline, are never empty and neither the matches nor the replacements depend on the start or end of the string.
+    /// std::regex rules cannot be analyzed and always return false.
+    bool isLineLocal() const
+    {
+        if (replacement.usesContext())
+        {
+            return false;
+        }
+        if (isLiteral())
+        {
+            return !ut1::contains(lhs, '\n');
+        }
+        if (isDfa())
+        {
+            const ut1::RegexNode& ast = dfa->getAst();
+            return !ut1::canMatchByte(ast, '\n') && !ut1::hasAssertion(ast, ut1::RegexNode::Assertion::BOL) && !ut1::hasAssertion(ast, ut1::RegexNode::Assertion::EOL) && (ut1::getMinMatchLength(ast) > 0);
+        }
+        return false;
+    }
+
+    /// Return the maximum length of a match of this rule, or std::string::npos if it is not bounded or the result depends on more than the matched text:
+    /// Matches must not be empty and neither the matches (assertions) nor the replacements may depend on the text around them.
+    /// Only DFA rules are analyzed (literal rules are split by SplitMode::LITERALS, std::regex rules cannot be analyzed).
+    size_t getMaxMatchLength() const
+    {
+        if (!isDfa() || replacement.usesContext())
+        {
+            return std::string::npos;
+        }
+        using enum ut1::RegexNode::Assertion;
+        const ut1::RegexNode& ast = dfa->getAst();
+        if (ut1::hasAssertion(ast, BOL) || ut1::hasAssertion(ast, EOL) || ut1::hasAssertion(ast, WORD_BOUNDARY) || ut1::hasAssertion(ast, NOT_WORD_BOUNDARY) || (ut1::getMinMatchLength(ast) == 0))
+        {
+            return std::string::npos;
+        }
+        return ut1::getMaxMatchLength(ast);
     }
 
     std::string lhs;
     std::string rhs;
+    ut1::ReplacementTemplate replacement; ///< Parsed rhs.
+    std::regex  regex;
+    std::optional<ut1::LiteralSearcher> literal;
+    std::optional<ut1::DfaRegex> dfa;
+    std::string fallbackReason; ///< Why --engine=dfa fell back to std::regex (empty if it did not).
     uint64_t    numMatches{};
 };
 
@@ -71,6 +178,91 @@ std::ostream& operator<<(std::ostream& os, const Rule& rule)
 }
 
 
+/// Statistics.
+class Stats
+{
+public:
+    /// Add other statistics.
+    Stats& operator+=(const Stats& other)
+    {
+        numIgnored += other.numIgnored;
+        numFilesProcessed += other.numFilesProcessed;
+        numFilesModified += other.numFilesModified;
+        numFilesRestored += other.numFilesRestored;
+        numFilesUnchanged += other.numFilesUnchanged;
+        numFilesRenamed += other.numFilesRenamed;
+        numFilesConsideredForRename += other.numFilesConsideredForRename;
+        numSymlinksProcessed += other.numSymlinksProcessed;
+        numSymlinksModified += other.numSymlinksModified;
+        numDirsProcessed += other.numDirsProcessed;
+        numDirsRenamed += other.numDirsRenamed;
+        numDirsConsideredForRename += other.numDirsConsideredForRename;
+        numFilesCached += other.numFilesCached;
+        return *this;
+    }
+
+    uint64_t numIgnored{};
+    uint64_t numFilesProcessed{};
+    uint64_t numFilesModified{};
+    uint64_t numFilesRestored{};
+    uint64_t numFilesUnchanged{}; ///< Matched but unchanged.
+    uint64_t numFilesRenamed{};
+    uint64_t numFilesConsideredForRename{};
+    uint64_t numSymlinksProcessed{};
+    uint64_t numSymlinksModified{};
+    uint64_t numDirsProcessed{};
+    uint64_t numDirsRenamed{};
+    uint64_t numDirsConsideredForRename{};
+    uint64_t numFilesCached{}; ///< Skipped (no match according to the no-match cache).
+};
+
+
+/// Per-thread processing state (one for the main thread and one for each --jobs worker thread).
+/// All state which is modified while processing files lives here, so the rules can be shared by all threads.
+class Context
+{
+public:
+    /// Constructor.
+    explicit Context(size_t numRules)
+    : dfaCaches(numRules)
+    , numMatches(numRules)
+    {
+    }
+
+    /// Write verbose output, previews and error messages to slot (or directly to stdout/stderr if slot is nullptr).
+    void setOutput(const ut1::OrderedOutput::SlotPtr& slot)
+    {
+        outStream = slot ? &slot->out : &std::cout;
+        errStream = slot ? &slot->err : &std::cerr;
+    }
+
+    /// Get output streams.
+    std::ostream& out() { return *outStream; }
+    std::ostream& err() { return *errStream; }
+
+    Stats stats;
+    std::vector<ut1::DfaRegex::Cache> dfaCaches; ///< One per rule.
+    std::vector<uint64_t> numMatches; ///< Matches per rule.
+
+    /// Ping-pong buffers for applyAllRules() (they keep their capacity across files).
+    std::array<std::string, 2> buffers;
+
+    /// Result of applyContentRules() for --line-mode.
+    std::string lines;
+
+    /// --select-lines/--ignore-lines: Result for the current range of selected lines, and the cache for the DFA of the line filter.
+    std::string              selectedLines;
+    ut1::DfaRegex::Cache     lineFilterCache;
+
+    /// No-match cache key of the file which is matched (countFile() records the file if it contains no match).
+    std::optional<ut1::NoMatchCache::Key> cacheKey;
+
+private:
+    std::ostream* outStream = &std::cout;
+    std::ostream* errStream = &std::cerr;
+};
+
+
 /// Steplace application logic.
 /// Todo: Lots.
 /// - Split out replacing logic from file handling logic.
@@ -87,12 +279,64 @@ public:
         followLinks = cl("follow-links");
         all         = cl("all");
         ignoreErrors = cl("ignore-errors");
+        numJobs      = unsigned(cl.getUInt("jobs"));
+        if (numJobs == 0)
+        {
+            numJobs = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+        prefetchDepth  = unsigned(cl.getUInt("prefetch"));
+        prefetchMemory = size_t(cl.getUInt("prefetch-memory")) * 1024 * 1024;
+        if (prefetchDepth && (numJobs > 1))
+        {
+            throw Error("--prefetch cannot be combined with --jobs");
+        }
+        std::string io = cl.getStr("io");
+        if ((io != "auto") && (io != "posix") && (io != "io_uring"))
+        {
+            throw Error("--io must be 'auto', 'posix' or 'io_uring' (got '" + io + "')");
+        }
+        // io_uring is detected at runtime, POSIX I/O is the fallback.
+        ioEngine = ((io != "posix") && ut1::isIoUringSupported()) ? ut1::IoEngine::IO_URING : ut1::IoEngine::POSIX;
+        ioFallback = (io == "io_uring") && (ioEngine != ut1::IoEngine::IO_URING);
+        fileWriter.emplace(cl("atomic"), unsigned(cl.getUInt("fsync")));
+        windowSize = size_t(cl.getUInt("window")) * 1024 * 1024;
+        useCache   = !cl("no-cache");
+        cacheFile  = cl.getStr("cache-file");
+        if (cacheFile.empty())
+        {
+            // No cache without a home directory.
+            const char* xdgCacheHome = std::getenv("XDG_CACHE_HOME");
+            const char* home         = std::getenv("HOME");
+            if (xdgCacheHome && *xdgCacheHome)
+            {
+                cacheFile = std::string(xdgCacheHome) + "/streplace/no-match-cache";
+            }
+            else if (home && *home)
+            {
+                cacheFile = std::string(home) + "/.cache/streplace/no-match-cache";
+            }
+        }
+        cacheSize  = size_t(cl.getUInt("cache-size")) * 1024 * 1024;
+        backup       = cl("backup");
+        backupSuffix = cl.getStr("suffix");
+        restore      = cl("restore");
+        if (backupSuffix.empty())
+        {
+            throw Error("--suffix must not be empty");
+        }
 
+        lineMode   = cl("line-mode");
         ignoreCase = cl("ignore-case");
         noRegex    = cl("no-regex");
         wholeWords = cl("whole-words");
         equals     = cl.getStr("equals");
         dollar     = cl.getStr("dollar");
+        std::string engine = cl.getStr("engine");
+        if ((engine != "std") && (engine != "dfa"))
+        {
+            throw Error("--engine must be 'std' or 'dfa' (got '" + engine + "')");
+        }
+        useDfa = engine == "dfa";
 
         verbose        = cl.getCount("verbose");
         dummyMode      = cl("dummy-mode");
@@ -112,9 +356,22 @@ public:
         {
             throw Error("--rename cannot be combined with --rename-only");
         }
+        if (restore && (rename || modifySymlinks))
+        {
+            throw Error("--restore cannot be combined with --rename, --rename-only or --modify-symlinks");
+        }
+        if (restore)
+        {
+            modifyFiles = false;
+        }
 
         // Implicit options.
         dummyMode |= preview;
+        if (preview)
+        {
+            // The preview shows whole files.
+            windowSize = 0;
+        }
 
         // Regex flags.
         regexFlags = std::regex::ECMAScript; // | std::regex::multiline;
@@ -130,6 +387,19 @@ public:
             regexFlags |= std::regex::icase;
         }
 
+        // --select-lines/--ignore-lines imply --line-mode.
+        if (cl("select-lines") && cl("ignore-lines"))
+        {
+            throw Error("--select-lines cannot be combined with --ignore-lines");
+        }
+        ignoreLines = cl("ignore-lines");
+        lineFilter  = cl.getStr(ignoreLines ? "ignore-lines" : "select-lines");
+        if (cl("select-lines") || ignoreLines)
+        {
+            compileLineFilter();
+            lineMode = true;
+        }
+
         if (equals.empty())
         {
             throw Error("--equals must not be empty");
@@ -174,7 +444,36 @@ public:
     /// Add rule.
     void addRule(const std::string& rule)
     {
-        rules.emplace_back(rule, equals, noRegex);
+        rules.emplace_back(rule, equals, dollar, noRegex, useDfa, regexFlags);
+    }
+
+    /// --select-lines/--ignore-lines: Compile lineFilter (like the left side of a rule).
+    void compileLineFilter()
+    {
+        if (useDfa)
+        {
+            try
+            {
+                lineFilterDfa.emplace(lineFilter, ignoreCase);
+                std::string literal = lineFilterDfa->getPrefilterLiteral();
+                if (!literal.empty())
+                {
+                    lineFilterPrefilter.emplace(literal, ignoreCase);
+                }
+                return;
+            }
+            catch (const ut1::DfaRegex::Unsupported&)
+            {
+            }
+        }
+        try
+        {
+            lineFilterRegex = std::regex(lineFilter, regexFlags);
+        }
+        catch (const std::regex_error& e)
+        {
+            throw Error("Invalid regex \"" + lineFilter + "\" for --" + (ignoreLines ? "ignore-lines" : "select-lines") + ": " + e.what());
+        }
     }
 
     /// Print rules.
@@ -183,7 +482,25 @@ public:
         std::cout << "Rules:\n";
         for (const Rule& rule: rules)
         {
-            std::cout << rule << "\n";
+            std::cout << rule;
+            if (rule.isDfa() && !rule.dfa->getPrefilterLiteral().empty())
+            {
+                std::cout << " (prefilter \"" << ut1::expandUnprintable(rule.dfa->getPrefilterLiteral()) << "\")";
+            }
+            if (!rule.fallbackReason.empty())
+            {
+                std::cout << " (std::regex: " << rule.fallbackReason << ")";
+            }
+            std::cout << "\n";
+        }
+        if (lineFilterDfa || lineFilterRegex)
+        {
+            std::cout << (ignoreLines ? "Ignoring" : "Selecting") << " lines matching \"" << lineFilter << "\"";
+            if (lineFilterPrefilter)
+            {
+                std::cout << " (prefilter \"" << ut1::expandUnprintable(lineFilterPrefilter->getNeedle()) << "\")";
+            }
+            std::cout << (lineFilterRegex ? " (std::regex)" : "") << "\n";
         }
     }
 
@@ -193,318 +510,1381 @@ public:
         return !rules.empty();
     }
 
+    /// Return true iff stdin can be processed ("-"): Only file contents are modified.
+    bool canProcessStdin() const
+    {
+        return modifyFiles && !rename;
+    }
+
+    /// Return true iff files are restored from their backups (--restore).
+    bool isRestoreMode() const
+    {
+        return restore;
+    }
+
+    /// Prepare rules for matching.
+    /// Call this after adding all rules.
+    void compileRules()
+    {
+        // Combine multiple literal rules into a single automaton which applies all rules in one pass.
+        bool allLiteral = std::all_of(rules.begin(), rules.end(), [](const Rule& rule) { return rule.isLiteral(); });
+        if (allLiteral && (rules.size() > 1))
+        {
+            multiLiteral.emplace(ignoreCase);
+            for (const Rule& rule: rules)
+            {
+                multiLiteral->addPattern(rule.lhs);
+            }
+            multiLiteral->build();
+        }
+
+        allLineLocal = std::all_of(rules.begin(), rules.end(), [](const Rule& rule) { return rule.isLineLocal(); });
+        if (lineMode)
+        {
+            // Each line is processed separately anyway.
+            splitMode = SplitMode::LINES;
+            if (numJobs > 1)
+            {
+                chunkPool.emplace(numJobs);
+                for (unsigned i = 0; i < numJobs; i++)
+                {
+                    chunkContexts.emplace_back(rules.size());
+                }
+            }
+            return;
+        }
+
+        // --window: Windows end after a newline if no rule can match across lines. Literal rules are not restricted to lines,
+        // since windows end where no left side can match across the end (this also works for binary files without newlines).
+        if (allLiteral && std::none_of(rules.begin(), rules.end(), [](const Rule& rule) { return rule.replacement.usesContext(); }))
+        {
+            splitMode = SplitMode::LITERALS;
+            for (const Rule& rule: rules)
+            {
+                maxLiteralSize = std::max(maxLiteralSize, rule.literal->size());
+            }
+        }
+        else if (allLineLocal)
+        {
+            splitMode = SplitMode::LINES;
+        }
+        else if ((rules.size() == 1) && !wholeWords && (rules[0].getMaxMatchLength() != std::string::npos))
+        {
+            // A single regex which can match across lines, but whose matches are bounded in length: Windows overlap by the longest match.
+            splitMode      = SplitMode::OVERLAP;
+            maxMatchLength = rules[0].getMaxMatchLength();
+        }
+    }
+
+    /// Process files and directories.
+    /// With --jobs > 1 directories are listed and regular files are processed by a thread pool.
+    void processPaths(std::vector<ut1::DirEntry>& paths)
+    {
+        // One context for the main thread and one for each worker thread (or for the writer thread of --prefetch).
+        for (size_t i = 0; i <= ((numJobs > 1) ? numJobs : (prefetchDepth ? 1 : 0)); i++)
+        {
+            contexts.emplace_back(rules.size());
+        }
+        if (numJobs > 1)
+        {
+            output.emplace();
+            pool.emplace(numJobs);
+
+            // Each queued entry keeps (at most) its parent directory open, so the queues must not exceed the limit of open files.
+            // Reserve fds for each thread (the file being processed and the directories being listed inline) and for everything else.
+            size_t maxOpenFiles = ut1::raiseOpenFileLimit(kMaxOpenFiles);
+            size_t reserved     = kReservedFds + size_t(numJobs + 1) * kReservedFdsPerJob;
+            size_t maxQueued    = (maxOpenFiles > reserved) ? (maxOpenFiles - reserved) : 0;
+            maxQueuedFiles      = std::min(size_t(numJobs) * kQueuedFilesPerJob, maxQueued / (kQueuedFilesPerJob + kQueuedDirsPerJob) * kQueuedFilesPerJob);
+            maxQueuedDirs       = std::min(size_t(numJobs) * kQueuedDirsPerJob, maxQueued / (kQueuedFilesPerJob + kQueuedDirsPerJob) * kQueuedDirsPerJob);
+        }
+        if (prefetchDepth)
+        {
+            output.emplace();
+            fileReader.emplace(ioEngine, std::min(prefetchDepth, kMaxPrefetchThreads), [this](const ut1::MappedFile& file) { prefetchedBytes += file.size(); });
+            if (verbose >= 2)
+            {
+                std::cout << "I/O engine: " << ut1::getIoEngineName(ioEngine) << (ioFallback ? " (io_uring is not available)" : "") << "\n";
+            }
+            writePool.emplace(1);
+        }
+        if (windowSize && (verbose >= 2))
+        {
+            std::cout << "Window split: " << getSplitModeStr() << "\n";
+        }
+        if (windowSize && (splitMode == SplitMode::NONE))
+        {
+            std::cerr << "Warning: --window is ignored and files are processed as a whole, since " << kNoSplitReason << ".\n";
+        }
+        // The cache is neither read nor written unless files are actually modified (not with --dummy-mode or --preview).
+        if (useCache && modifyFiles && !dummyMode && !cacheFile.empty())
+        {
+            noMatchCache.emplace(cacheFile, getRulesHash(), cacheSize);
+        }
+
+        for (ut1::DirEntry& path: paths)
+        {
+            processDirectoryEntry(contexts[0], path, createOutputSlot(nullptr));
+        }
+        if (pool)
+        {
+            pool->wait();
+        }
+        while (!prefetchQueue.empty())
+        {
+            matchPrefetchedFile(contexts[0]);
+        }
+        if (writePool)
+        {
+            writePool->wait();
+        }
+        try
+        {
+            fileWriter->flush();
+        }
+        catch (const std::exception& e)
+        {
+            if (!ignoreErrors)
+            {
+                throw;
+            }
+            if (verbose)
+            {
+                std::cerr << e.what() << "\n";
+            }
+            contexts[0].stats.numIgnored++;
+        }
+        if (noMatchCache)
+        {
+            try
+            {
+                noMatchCache->save();
+            }
+            catch (const std::exception& e)
+            {
+                // The cache only saves time.
+                std::cerr << "Warning: " << e.what() << "\n";
+            }
+        }
+        mergeStats();
+    }
+
+    /// Get hash of everything which determines whether a file contains a match (not the right sides of the rules), for the no-match cache.
+    uint64_t getRulesHash() const
+    {
+        std::string s = "streplace no-match 1 ";
+        for (bool flag: {ignoreCase, noRegex, useDfa, wholeWords, lineMode, ignoreLines})
+        {
+            s += flag ? '1' : '0';
+        }
+        s += '\0' + lineFilter;
+        for (const Rule& rule: rules)
+        {
+            s += '\0' + rule.lhs;
+        }
+        return ut1::NoMatchCache::hash(s);
+    }
+
+    /// --cache: Return true iff directoryEntry is known to contain no match, so it does not need to be read.
+    /// Else set ctx.cacheKey for countFile().
+    bool isCachedNoMatch(Context& ctx, const ut1::DirEntry& directoryEntry)
+    {
+        ctx.cacheKey.reset();
+        if (!noMatchCache)
+        {
+            return false;
+        }
+        ut1::NoMatchCache::Key key = noMatchCache->getKey(directoryEntry.getStat());
+        if (noMatchCache->contains(key))
+        {
+            if (verbose >= 2)
+            {
+                ctx.out() << "Skipping " << directoryEntry.path().string() << " (no match cached)\n";
+            }
+            ctx.stats.numFilesCached++;
+            return true;
+        }
+        ctx.cacheKey = key;
+        return false;
+    }
+
+    /// Process stdin and write the result to stdout ("-", filter mode).
+    /// Stdin is read in blocks of up to kStdinBlockSize (or --window) bytes. Each block is processed and written as soon as it can be split (see getWindowEnd()),
+    /// so output is not delayed until the end of the input and memory use is bounded.
+    /// Rules which cannot be split (see splitMode, a warning is printed) and --preview read all input first. With --dummy-mode nothing is written.
+    void processStdin()
+    {
+        contexts.emplace_back(rules.size());
+        Context&                    ctx = contexts[0];
+        const std::filesystem::path path("<stdin>");
+        size_t                      blockSize = windowSize ? windowSize : kStdinBlockSize;
+        auto                        writeOutput = [this](std::string_view data)
+        {
+            if (!dummyMode && ((std::fwrite(data.data(), 1, data.size(), stdout) != data.size()) || (std::fflush(stdout) != 0)))
+            {
+                throw Error("Error while writing to stdout");
+            }
+        };
+
+        if (verbose >= 2)
+        {
+            ctx.out() << "Processing " << path.string() << ut1::flushTty;
+        }
+        std::string buffer;
+        std::string block(blockSize, '\0');
+        auto        readBlock = [&]()
+        {
+            size_t n = ut1::readSome(0, block.data(), block.size(), path.string());
+            buffer.append(block, 0, n);
+            return n;
+        };
+        if ((splitMode == SplitMode::NONE) || preview)
+        {
+            if (!preview)
+            {
+                std::cerr << "Warning: All input is read before it is processed, since " << kNoSplitReason << ".\n";
+            }
+            while (readBlock())
+            {
+            }
+            ut1::MappedFile  file = ut1::MappedFile::fromBuffer(std::move(buffer));
+            std::string_view result;
+            writeOutput(matchFile(ctx, path, file, result) ? result : file.view());
+            mergeStats();
+            return;
+        }
+
+        ctx.stats.numFilesProcessed++;
+        size_t numMatches = 0;
+        bool   changed    = false;
+        bool   complete   = false;
+        while (!complete)
+        {
+            complete = readBlock() == 0;
+
+            // Process and write all windows which are complete.
+            size_t pos = 0;
+            for (size_t end; (pos < buffer.size()) && ((end = getWindowEnd(buffer, pos, blockSize, complete)) != std::string::npos); pos = end)
+            {
+                size_t           windowMatches = 0;
+                std::string_view result        = applyWindowRules(ctx, buffer, pos, end, complete, &windowMatches);
+                std::string_view window        = std::string_view(buffer).substr(pos, end - pos);
+                numMatches += windowMatches;
+                changed |= windowMatches && ((result.size() != window.size()) || (result != window));
+                writeOutput(result);
+            }
+            buffer.erase(0, pos);
+        }
+        countFile(ctx, path, numMatches, changed);
+        mergeStats();
+    }
+
+    /// Merge per-thread statistics.
+    void mergeStats()
+    {
+        auto merge = [&](const Context& ctx)
+        {
+            stats += ctx.stats;
+            for (size_t i = 0; i < rules.size(); i++)
+            {
+                rules[i].numMatches += ctx.numMatches[i];
+            }
+        };
+        std::for_each(contexts.begin(), contexts.end(), merge);
+        std::for_each(chunkContexts.begin(), chunkContexts.end(), merge); // --line-mode chunks.
+    }
+
+    /// Print statistics.
+    void printStats()
+    {
+        std::vector<std::string> l;
+        if (stats.numFilesProcessed)
+        {
+            l.push_back(std::to_string(stats.numFilesModified) + "/" + std::to_string(stats.numFilesProcessed) + " file" + ut1::pluralS(stats.numFilesModified) + " modified");
+        }
+        if (stats.numFilesCached)
+        {
+            l.push_back(std::to_string(stats.numFilesCached) + " file" + ut1::pluralS(stats.numFilesCached) + " skipped (no match cached)");
+        }
+        if (stats.numFilesUnchanged)
+        {
+            l.push_back(std::to_string(stats.numFilesUnchanged) + " file" + ut1::pluralS(stats.numFilesUnchanged) + " matched but unchanged");
+        }
+        if (stats.numFilesRestored)
+        {
+            l.push_back(std::to_string(stats.numFilesRestored) + " file" + ut1::pluralS(stats.numFilesRestored) + " restored");
+        }
+        if (stats.numSymlinksProcessed)
+        {
+            l.push_back(std::to_string(stats.numSymlinksModified) + "/" + std::to_string(stats.numSymlinksProcessed) + " symlink" + ut1::pluralS(stats.numSymlinksModified) + " modified");
+        }
+        if (stats.numFilesRenamed)
+        {
+            l.push_back(std::to_string(stats.numFilesRenamed) + "/" + std::to_string(stats.numFilesConsideredForRename) + " file" + ut1::pluralS(stats.numFilesRenamed) + " renamed");
+        }
+        if (stats.numDirsRenamed)
+        {
+            l.push_back(std::to_string(stats.numDirsRenamed) + "/" + std::to_string(stats.numDirsConsideredForRename) + " dir" + ut1::pluralS(stats.numDirsRenamed) + " renamed");
+        }
+        else if (stats.numDirsProcessed)
+        {
+            l.push_back(std::to_string(stats.numDirsProcessed) + " dir" + ut1::pluralS(stats.numDirsProcessed) + " processed");
+        }
+        if (verbose >= 2)
+        {
+            uint64_t numRegexesCompiled = Rule::numRegexesCompiled;
+            l.push_back(std::to_string(numRegexesCompiled) + " regex" + ut1::pluralS(numRegexesCompiled, "es") + " compiled for " + std::to_string(rules.size()) + " rule" + ut1::pluralS(rules.size()));
+        }
+        if (!l.empty())
+        {
+            std::cout << "(" << ut1::joinStrings(l, ", ") << ")\n";
+        }
+    }
+
+private:
+    /// Create output slot for a directory entry (nullptr without --jobs: Output is written directly).
+    ut1::OrderedOutput::SlotPtr createOutputSlot(const ut1::OrderedOutput::SlotPtr& parent)
+    {
+        return output ? output->createSlot(parent) : nullptr;
+    }
+
+    /// Mark output slot as complete.
+    void finishOutputSlot(const ut1::OrderedOutput::SlotPtr& slot)
+    {
+        if (slot)
+        {
+            output->finish(slot);
+        }
+    }
+
+    /// Handle error for path: Rethrow the exception which is currently handled unless --ignore-errors is specified.
+    /// The message goes into slot (which is finished before rethrowing, so all output up to the error is printed).
+    /// Must be called from a catch block.
+    void ignoreError(Context& ctx, const ut1::OrderedOutput::SlotPtr& slot, const std::string& what, const std::filesystem::path& path, const std::exception& e)
+    {
+        ctx.setOutput(slot);
+        if (!ignoreErrors)
+        {
+            finishOutputSlot(slot);
+            throw;
+        }
+        if (verbose)
+        {
+            ctx.err() << what << " " << path.string() << ": " << e.what() << "\n";
+        }
+        ctx.stats.numIgnored++;
+    }
+
     /// Process directory entry (rename and modify content).
-    void processDirectoryEntry(std::filesystem::directory_entry& directoryEntry)
+    /// Output is written into slot.
+    void processDirectoryEntry(Context& ctx, ut1::DirEntry& directoryEntry, const ut1::OrderedOutput::SlotPtr& slot)
     {
+        ctx.setOutput(slot);
         try
         {
-            if (directoryEntry.is_regular_file() && !isAllowedExtension(directoryEntry.path()))
+            // The type is known from reading the parent directory. Only symlinks need a stat() (to get the type of the target).
+            ut1::FileType type      = directoryEntry.type(true);
+            bool          isSymlink = directoryEntry.type() == ut1::FileType::SYMLINK;
+            if ((type == ut1::FileType::REGULAR) && !isAllowedExtension(directoryEntry.path()))
             {
                 if (verbose >= 2)
                 {
-                    std::cout << "Ignoring file " << directoryEntry.path().string() << ".\n";
+                    ctx.out() << "Ignoring file " << directoryEntry.path().string() << ".\n";
                 }
-                numIgnored++;
+                ctx.stats.numIgnored++;
+                finishOutputSlot(slot);
+                return;
+            }
+            if ((type == ut1::FileType::REGULAR) && ut1::hasSuffix(directoryEntry.path().filename().string(), backupSuffix))
+            {
+                if (verbose >= 2)
+                {
+                    ctx.out() << "Ignoring backup file " << directoryEntry.path().string() << ".\n";
+                }
+                finishOutputSlot(slot);
                 return;
             }
 
             // Rename files and dirs.
+            // This happens before the contents are processed (or listed) by any thread, so paths are always up to date.
             if (rename)
             {
-                bool wasRegularFile = directoryEntry.is_regular_file();
-                bool wasDirectory   = directoryEntry.is_directory();
+                bool wasRegularFile = type == ut1::FileType::REGULAR;
+                bool wasDirectory   = type == ut1::FileType::DIR;
                 if (wasRegularFile)
                 {
-                    numFilesConsideredForRename++;
+                    ctx.stats.numFilesConsideredForRename++;
                 }
                 else if (wasDirectory)
                 {
-                    numDirsConsideredForRename++;
+                    ctx.stats.numDirsConsideredForRename++;
                 }
                 std::filesystem::path oldPath = directoryEntry.path();
                 std::filesystem::path basePath = oldPath.parent_path();
                 std::string oldName = oldPath.filename().string();
-                std::string newName = applyAllRules(oldName);
+                std::string newName(applyAllRules(ctx, oldName));
                 if (oldName != newName)
                 {
                     std::filesystem::path newPath = basePath / newName;
                     if (verbose)
                     {
-                        std::cout << "Renaming " << oldPath.string() << " -> " << newPath.string() << ".\n";
+                        ctx.out() << "Renaming " << oldPath.string() << " -> " << newPath.string() << ".\n";
                     }
                     if (!dummyMode)
                     {
-                        std::filesystem::rename(oldPath, newPath);
-                        directoryEntry.replace_filename(newName);
+                        directoryEntry.rename(newName);
                     }
                     if (wasRegularFile)
                     {
-                        numFilesRenamed++;
+                        ctx.stats.numFilesRenamed++;
                     }
                     else if (wasDirectory)
                     {
-                        numDirsRenamed++;
+                        ctx.stats.numDirsRenamed++;
                     }
                 }
             }
 
             // Process content.
-            if ((!followLinks) && directoryEntry.is_symlink())
+            if ((!followLinks) && isSymlink)
             {
-                processSymlink(directoryEntry);
+                processSymlink(ctx, directoryEntry);
             }
-            else if (directoryEntry.is_regular_file())
+            else if (type == ut1::FileType::REGULAR)
             {
-                processRegularFile(directoryEntry);
+                if (restore)
+                {
+                    restoreRegularFile(ctx, directoryEntry);
+                }
+                if (fileReader && modifyFiles)
+                {
+                    prefetchRegularFile(ctx, directoryEntry, slot);
+                    return;
+                }
+                // Bounded queue: Process the file on this thread if enough files are queued already.
+                auto processFile = [this, directoryEntry](Context& taskCtx) { processRegularFile(taskCtx, directoryEntry); };
+                if (pool && modifyFiles && (numQueuedFiles < maxQueuedFiles) && !tooManyOpenFiles)
+                {
+                    submitTask(directoryEntry, slot, processFile, &numQueuedFiles);
+                    return;
+                }
+                if (!runOrDefer(ctx, directoryEntry, slot, processFile))
+                {
+                    return;
+                }
             }
-            else if (directoryEntry.is_directory())
+            else if (type == ut1::FileType::DIR)
             {
-                processDirectory(directoryEntry);
+                // Subdirectories are listed concurrently (queued entries keep their parent directory open, so the queue is bounded as well).
+                auto processDir = [this, directoryEntry, slot](Context& taskCtx) { processDirectory(taskCtx, directoryEntry, slot); };
+                if (pool && recursive && (numQueuedDirs < maxQueuedDirs) && !tooManyOpenFiles)
+                {
+                    submitTask(directoryEntry, slot, processDir, &numQueuedDirs);
+                    return;
+                }
+                if (!runOrDefer(ctx, directoryEntry, slot, processDir))
+                {
+                    return;
+                }
             }
             else
             {
-                processOther(directoryEntry);
+                processOther(ctx, directoryEntry);
             }
         }
         catch (const std::exception& e)
         {
-            if (!ignoreErrors)
+            ignoreError(ctx, slot, "Skipping", directoryEntry.path(), e);
+        }
+        finishOutputSlot(slot);
+    }
+
+    /// Process the contents of directoryEntry on a worker thread by calling f(ctx) (see runOrDefer()).
+    /// The output goes into slot, which is finished afterwards.
+    /// numQueued (if not nullptr) is incremented until the task starts.
+    template<typename F>
+    void submitTask(const ut1::DirEntry& directoryEntry, const ut1::OrderedOutput::SlotPtr& slot, F f, std::atomic<size_t>* numQueued = nullptr, unsigned attempt = 0)
+    {
+        if (numQueued)
+        {
+            (*numQueued)++;
+        }
+        pool->submit([this, directoryEntry, slot, f, numQueued, attempt](unsigned worker)
+            {
+                if (numQueued)
+                {
+                    (*numQueued)--;
+                }
+                Context& ctx = contexts[worker + 1];
+                ctx.setOutput(slot);
+                try
+                {
+                    if (!runOrDefer(ctx, directoryEntry, slot, f, attempt))
+                    {
+                        return;
+                    }
+                }
+                catch (const std::exception& e)
+                {
+                    ignoreError(ctx, slot, "Skipping", directoryEntry.path(), e);
+                }
+                finishOutputSlot(slot);
+            });
+    }
+
+    /// Process the contents of directoryEntry by calling f(ctx) and return true.
+    /// With --jobs, if f fails to open a file or dir because too many files are open, submit f for another attempt instead and
+    /// return false (the task finishes slot then): Queued entries keep their parent directories open until other threads process them.
+    /// No more entries are queued from then on (they are processed inline), so the number of open files shrinks.
+    template<typename F>
+    bool runOrDefer(Context& ctx, const ut1::DirEntry& directoryEntry, const ut1::OrderedOutput::SlotPtr& slot, F f, unsigned attempt = 0)
+    {
+        try
+        {
+            f(ctx);
+            return true;
+        }
+        catch (const std::exception& e)
+        {
+            if (!isTooManyOpenFiles(e) || (attempt >= kMaxOpenRetries))
             {
                 throw;
             }
-            if (verbose)
+        }
+        tooManyOpenFiles = true;
+        if (attempt > 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        submitTask(directoryEntry, slot, f, nullptr, attempt + 1);
+        return false;
+    }
+
+    /// Return true iff e is a failure to open a file or dir because too many files are open (EMFILE) and --jobs is used.
+    /// Such failures are retried by runOrDefer(). They happen before anything is changed or counted (see processRegularFile() and processDirectory()).
+    bool isTooManyOpenFiles(const std::exception& e) const noexcept
+    {
+        const std::system_error* error = dynamic_cast<const std::system_error*>(&e);
+        return pool && error && (error->code() == std::errc::too_many_files_open);
+    }
+
+    /// Get file type string, e.g. "file" or "directory".
+    std::string getFileTypeStr(const ut1::DirEntry& directoryEntry)
+    {
+        switch (directoryEntry.type(followLinks))
+        {
+        case ut1::FileType::SYMLINK: return "symlink";
+        case ut1::FileType::REGULAR: return "file";
+        case ut1::FileType::DIR: return "directory";
+        case ut1::FileType::BLOCK: return "block device";
+        case ut1::FileType::CHAR: return "characters device";
+        case ut1::FileType::FIFO: return "fifo";
+        case ut1::FileType::SOCKET: return "socket";
+        default: return "unknown file type";
+        }
+    }
+
+    /// Apply all rules.
+    /// Return the result, which is either input itself (if nothing matched) or one of the ping-pong buffers.
+    /// The result is only valid until the next call.
+    std::string_view applyAllRules(Context& ctx, std::string_view input, size_t* numMatchesOut = nullptr)
+    {
+        // Each rule reads from current and writes into the other buffer.
+        // Rules without matches do not write anything and current stays the same.
+        std::string_view current       = input;
+        std::string*     currentBuffer = nullptr;
+        size_t           numMatches    = 0;
+        auto getOutputBuffer = [&]() -> std::string&
+        {
+            std::string& out = (currentBuffer == &ctx.buffers[0]) ? ctx.buffers[1] : ctx.buffers[0];
+            out.clear();
+            return out;
+        };
+        auto setCurrent = [&](std::string& out)
+        {
+            currentBuffer = &out;
+            current       = out;
+        };
+        if (multiLiteral)
+        {
+            std::string& out = getOutputBuffer();
+            numMatches       = applyMultiLiteralRules(ctx, current, out);
+            if (numMatches)
+            {
+                setCurrent(out);
+            }
+        }
+        else
+        {
+            for (size_t i = 0; i < rules.size(); i++)
+            {
+                std::string& out        = getOutputBuffer();
+                uint64_t     ruleMatches = applyRule(ctx, current, out, i);
+                if (ruleMatches)
+                {
+                    numMatches += ruleMatches;
+                    setCurrent(out);
+                }
+            }
+        }
+        if (numMatchesOut)
+        {
+            *numMatchesOut = numMatches;
+        }
+        return current;
+    }
+
+    /// Apply all rules to file contents (or to a window of the contents): Like applyAllRules(), but with --line-mode to each line separately.
+    /// Return the result, which is either input itself (if nothing matched), one of the ping-pong buffers or ctx.lines.
+    /// The result is only valid until the next call.
+    std::string_view applyContentRules(Context& ctx, std::string_view input, size_t* numMatchesOut = nullptr)
+    {
+        if (!lineMode)
+        {
+            return applyAllRules(ctx, input, numMatchesOut);
+        }
+        if (chunkPool && (input.size() > kChunkSize))
+        {
+            return applyLineRulesParallel(ctx, input, numMatchesOut);
+        }
+        return applyLineRules(ctx, input, ctx.lines, numMatchesOut);
+    }
+
+    /// --line-mode: Apply all rules to each line of input (without its newline) which is selected by --select-lines/--ignore-lines.
+    /// Only the ranges of selected lines are passed to the rules.
+    /// Return the result, which is either input itself (if nothing matched), one of the ping-pong buffers or out.
+    std::string_view applyLineRules(Context& ctx, std::string_view input, std::string& out, size_t* numMatchesOut)
+    {
+        if (!lineFilterDfa && !lineFilterRegex)
+        {
+            return applyRulesToLines(ctx, input, out, numMatchesOut);
+        }
+
+        // out is only written from the first match on: Everything before it is copied then.
+        size_t numMatches = 0;
+        size_t copied     = 0;
+        forEachSelectedRange(ctx, input, [&](size_t begin, size_t end)
+        {
+            size_t           rangeMatches = 0;
+            std::string_view result       = applyRulesToLines(ctx, input.substr(begin, end - begin), ctx.selectedLines, &rangeMatches);
+            if (rangeMatches)
+            {
+                if (!numMatches)
+                {
+                    out.clear();
+                }
+                out.append(input, copied, begin - copied);
+                out += result;
+                copied = end;
+                numMatches += rangeMatches;
+            }
+        });
+        if (numMatchesOut)
+        {
+            *numMatchesOut = numMatches;
+        }
+        if (!numMatches)
+        {
+            return input;
+        }
+        out.append(input, copied);
+        return out;
+    }
+
+    /// --select-lines/--ignore-lines: Call f(begin, end) for each range of consecutive selected lines in s, in order.
+    /// end is after the newline of the last line of the range (or s.size()).
+    /// This is a single pass over s: Only lines which contain the prefilter literal are matched against the line filter.
+    template<typename F>
+    void forEachSelectedRange(Context& ctx, std::string_view s, F f) const
+    {
+        size_t rangeBegin = std::string::npos;
+        auto   classify   = [&](size_t begin, bool selected)
+        {
+            if (selected && (rangeBegin == std::string::npos))
+            {
+                rangeBegin = begin;
+            }
+            else if (!selected && (rangeBegin != std::string::npos))
             {
-                std::cerr << "Skipping " << directoryEntry.path().string() << ": " << e.what() << "\n";
+                f(rangeBegin, begin);
+                rangeBegin = std::string::npos;
             }
-            numIgnored++;
+        };
+        for (size_t pos = 0; pos < s.size();)
+        {
+            // All lines before the line containing the next candidate do not match.
+            size_t candidate = lineFilterPrefilter ? lineFilterPrefilter->find(s, pos) : pos;
+            if (candidate == std::string::npos)
+            {
+                classify(pos, ignoreLines);
+                break;
+            }
+            size_t lineBegin = s.substr(pos, candidate - pos).rfind('\n');
+            lineBegin        = (lineBegin == std::string::npos) ? pos : pos + lineBegin + 1;
+            if (lineBegin > pos)
+            {
+                classify(pos, ignoreLines);
+            }
+            size_t newline = newlineSearcher.find(s, candidate);
+            size_t lineEnd = std::min(newline, s.size());
+            classify(lineBegin, matchesLineFilter(ctx, s.substr(lineBegin, lineEnd - lineBegin)) != ignoreLines);
+            pos = (newline == std::string::npos) ? lineEnd : newline + 1;
+        }
+        if (rangeBegin != std::string::npos)
+        {
+            f(rangeBegin, s.size());
+        }
+    }
+
+    /// Return true iff line (without its newline) matches --select-lines/--ignore-lines.
+    bool matchesLineFilter(Context& ctx, std::string_view line) const
+    {
+        if (lineFilterDfa)
+        {
+            ut1::DfaRegex::Match match;
+            return lineFilterDfa->search(line, 0, match, ctx.lineFilterCache);
+        }
+        return std::regex_search(line.begin(), line.end(), *lineFilterRegex);
+    }
+
+    /// --line-mode: Apply all rules to each line of input (without its newline).
+    /// Return the result, which is either input itself (if nothing matched), one of the ping-pong buffers or out.
+    std::string_view applyRulesToLines(Context& ctx, std::string_view input, std::string& out, size_t* numMatchesOut)
+    {
+        if (allLineLocal)
+        {
+            // No match can contain a newline or depend on the start or end of the input, so the result is the same for all lines at once.
+            return applyAllRules(ctx, input, numMatchesOut);
+        }
+
+        // out is only written from the first match on: Lines before it are copied then.
+        size_t numMatches = 0;
+        for (size_t pos = 0; pos < input.size();)
+        {
+            size_t           newline     = newlineSearcher.find(input, pos);
+            size_t           end         = std::min(newline, input.size());
+            size_t           lineMatches = 0;
+            std::string_view result      = applyAllRules(ctx, input.substr(pos, end - pos), &lineMatches);
+            if (lineMatches && !numMatches)
+            {
+                out.assign(input, 0, pos);
+            }
+            numMatches += lineMatches;
+            if (numMatches)
+            {
+                out += result;
+                if (newline != std::string::npos)
+                {
+                    out += '\n';
+                }
+            }
+            pos = (newline == std::string::npos) ? end : newline + 1;
+        }
+        if (numMatchesOut)
+        {
+            *numMatchesOut = numMatches;
+        }
+        return numMatches ? std::string_view(out) : input;
+    }
+
+    /// --line-mode with --jobs: Split input into chunks of lines which are matched in parallel by chunkPool and reassembled in order into ctx.lines.
+    /// Return the result, which is either input itself (if nothing matched) or ctx.lines.
+    std::string_view applyLineRulesParallel(Context& ctx, std::string_view input, size_t* numMatchesOut)
+    {
+        struct Chunk
+        {
+            std::string_view   input;
+            std::string        out;
+            size_t             numMatches{};
+            std::promise<void> done;
+        };
+        std::vector<Chunk> chunks;
+        for (size_t pos = 0, end; pos < input.size(); pos = end)
+        {
+            end = getWindowEnd(input, pos, kChunkSize);
+            chunks.emplace_back().input = input.substr(pos, end - pos);
+        }
+        std::vector<std::future<void>> done;
+        for (Chunk& chunk: chunks)
+        {
+            done.push_back(chunk.done.get_future());
+            chunkPool->submit([this, &chunk](unsigned worker)
+            {
+                try
+                {
+                    std::string_view result = applyLineRules(chunkContexts[worker], chunk.input, chunk.out, &chunk.numMatches);
+                    if (chunk.numMatches && (result.data() != chunk.out.data()))
+                    {
+                        // The ping-pong buffers of the worker are reused by its next chunk.
+                        chunk.out.assign(result);
+                    }
+                    chunk.done.set_value();
+                }
+                catch (...)
+                {
+                    chunk.done.set_exception(std::current_exception());
+                }
+            });
+        }
+
+        // All chunks must be done before chunks goes away, even if one of them failed.
+        for (std::future<void>& f: done)
+        {
+            f.wait();
+        }
+        size_t numMatches = 0;
+        for (size_t i = 0; i < chunks.size(); i++)
+        {
+            done[i].get();
+            numMatches += chunks[i].numMatches;
+        }
+        if (numMatchesOut)
+        {
+            *numMatchesOut = numMatches;
+        }
+        if (!numMatches)
+        {
+            return input;
         }
+        ctx.lines.clear();
+        for (const Chunk& chunk: chunks)
+        {
+            ctx.lines += chunk.numMatches ? std::string_view(chunk.out) : chunk.input;
+        }
+        return ctx.lines;
     }
 
-    /// Print statistics.
-    void printStats()
+    /// --backup: Copy file to its backup file before it is modified for the first time (an existing backup is kept).
+    void makeBackup(Context& ctx, const ut1::DirEntry& directoryEntry)
     {
-        std::vector<std::string> l;
-        if (numFilesProcessed)
+        if (!backup)
         {
-            l.push_back(std::to_string(numFilesModified) + "/" + std::to_string(numFilesProcessed) + " file" + ut1::pluralS(numFilesModified) + " modified");
+            return;
         }
-        if (numSymlinksProcessed)
+        ut1::DirEntry backupEntry = directoryEntry.getSibling(directoryEntry.path().filename().string() + backupSuffix);
+        if (backupEntry.type() != ut1::FileType::NON_EXISTING)
         {
-            l.push_back(std::to_string(numSymlinksModified) + "/" + std::to_string(numSymlinksProcessed) + " symlink" + ut1::pluralS(numSymlinksModified) + " modified");
+            if (verbose)
+            {
+                ctx.out() << "Keeping old version of backup file " << backupEntry.path().string() << ".\n";
+            }
+            return;
         }
-        if (numFilesRenamed)
+        ut1::CopyMethod method = directoryEntry.copyFile(backupEntry);
+        if (verbose)
         {
-            l.push_back(std::to_string(numFilesRenamed) + "/" + std::to_string(numFilesConsideredForRename) + " file" + ut1::pluralS(numFilesRenamed) + " renamed");
+            ctx.out() << "Creating backup file " << backupEntry.path().string() << (verbose >= 2 ? std::string(" (") + ut1::getCopyMethodStr(method) + ")" : std::string()) << ".\n";
         }
-        if (numDirsRenamed)
+    }
+
+    /// --restore: Replace file by its backup file (if it exists).
+    void restoreRegularFile(Context& ctx, const ut1::DirEntry& directoryEntry)
+    {
+        ut1::DirEntry backupEntry = directoryEntry.getSibling(directoryEntry.path().filename().string() + backupSuffix);
+        if (backupEntry.type() != ut1::FileType::REGULAR)
         {
-            l.push_back(std::to_string(numDirsRenamed) + "/" + std::to_string(numDirsConsideredForRename) + " dir" + ut1::pluralS(numDirsRenamed) + " renamed");
+            return;
         }
-        else if (numDirsProcessed)
+        if (verbose)
         {
-            l.push_back(std::to_string(numDirsProcessed) + " dir" + ut1::pluralS(numDirsProcessed) + " processed");
+            ctx.out() << "Restoring " << directoryEntry.path().string() << ".\n";
         }
-        if (!l.empty())
+        if (!dummyMode)
         {
-            std::cout << "(" << ut1::joinStrings(l, ", ") << ")\n";
+            backupEntry.rename(directoryEntry.path().filename().string());
         }
+        ctx.stats.numFilesRestored++;
     }
 
-private:
-    /// Get file type string, e.g. "file" or "directory".
-    std::string getFileTypeStr(const std::filesystem::directory_entry& directoryEntry)
+    /// Process regular file.
+    void processRegularFile(Context& ctx, const ut1::DirEntry& directoryEntry)
     {
-        if ((!followLinks) && directoryEntry.is_symlink())
+        if (!modifyFiles || isCachedNoMatch(ctx, directoryEntry))
         {
-            return "symlink";
+            return;
         }
-        else if (directoryEntry.is_regular_file())
+
+        // Map file (files without matches are never copied).
+        // This is the first operation which opens a file, so it can be retried on EMFILE (see runOrDefer()).
+        ut1::MappedFile file = directoryEntry.map();
+        if (verbose >= 2)
         {
-            return "file";
+            ctx.out() << "Processing " << directoryEntry.path().string() << ut1::flushTty;
         }
-        else if (directoryEntry.is_directory())
+        if (windowSize && streamRegularFile(ctx, directoryEntry, file))
         {
-            return "directory";
+            return;
         }
-        else if (directoryEntry.is_block_file())
+        std::string_view result;
+        if (matchFile(ctx, directoryEntry.path(), file, result) && !dummyMode)
         {
-            return "block device";
+            makeBackup(ctx, directoryEntry);
+            if ((result.size() == file.size()) && fileWriter->canWriteChanges())
+            {
+                // Equal-length replacements: Write only the changed byte ranges.
+                std::vector<ut1::FileWriter::Change> changes = ut1::FileWriter::getChanges(file.view(), result);
+                file.close();
+                fileWriter->writeChanges(directoryEntry, changes);
+                return;
+            }
+            // Write file (the result is in one of the buffers, so the file can be unmapped before it is overwritten).
+            file.close();
+            fileWriter->write(directoryEntry, result);
         }
-        else if (directoryEntry.is_character_file())
+    }
+
+    /// --prefetch: Read regular file in the background and match the oldest prefetched files when the pipeline is full.
+    /// The output goes into slot, which is finished after the file is written.
+    void prefetchRegularFile(Context& ctx, const ut1::DirEntry& directoryEntry, const ut1::OrderedOutput::SlotPtr& slot)
+    {
+        if (isCachedNoMatch(ctx, directoryEntry))
         {
-            return "characters device";
+            finishOutputSlot(slot);
+            return;
         }
-        else if (directoryEntry.is_fifo())
+        prefetchQueue.push_back({directoryEntry, slot, fileReader->read(directoryEntry), ctx.cacheKey});
+        while ((prefetchQueue.size() > prefetchDepth) || ((!prefetchQueue.empty()) && (prefetchedBytes > prefetchMemory)))
         {
-            return "fifo";
+            matchPrefetchedFile(ctx);
         }
-        else if (directoryEntry.is_socket())
+    }
+
+    /// --prefetch: Match the oldest prefetched file (waiting until it is read) and pass the result to the writer thread.
+    void matchPrefetchedFile(Context& ctx)
+    {
+        PrefetchedFile prefetched = std::move(prefetchQueue.front());
+        prefetchQueue.pop_front();
+        ctx.setOutput(prefetched.slot);
+        ctx.cacheKey = prefetched.cacheKey;
+        try
         {
-            return "socket";
+            if (verbose >= 2)
+            {
+                ctx.out() << "Processing " << prefetched.entry.path().string();
+            }
+            ut1::MappedFile file = prefetched.file.get();
+            prefetchedBytes -= file.size();
+            std::string_view result;
+            if (windowSize && streamRegularFile(ctx, prefetched.entry, file))
+            {
+                // Large files are processed on this thread.
+            }
+            else if (matchFile(ctx, prefetched.entry.path(), file, result) && !dummyMode)
+            {
+                // The writer thread owns a copy of the result or of the changed byte ranges (the buffers of ctx are reused for the next file).
+                std::string                          data;
+                std::vector<ut1::FileWriter::Change> changes;
+                bool onlyChanges = (result.size() == file.size()) && fileWriter->canWriteChanges();
+                if (onlyChanges)
+                {
+                    changes = ut1::FileWriter::getChanges(file.view(), result);
+                }
+                else
+                {
+                    data = result;
+                }
+                file.close();
+                size_t numBytes = data.size();
+                for (const ut1::FileWriter::Change& change: changes)
+                {
+                    numBytes += change.data.size();
+                }
+                prefetchedBytes += numBytes;
+                writePool->submit([this, entry = prefetched.entry, slot = prefetched.slot, data = std::move(data), changes = std::move(changes), onlyChanges, numBytes](unsigned worker)
+                    {
+                        Context& writerCtx = contexts[worker + 1];
+                        try
+                        {
+                            makeBackup(writerCtx, entry);
+                            if (onlyChanges)
+                            {
+                                fileWriter->writeChanges(entry, changes);
+                            }
+                            else
+                            {
+                                fileWriter->write(entry, data);
+                            }
+                        }
+                        catch (const std::exception& e)
+                        {
+                            ignoreError(writerCtx, slot, "Skipping", entry.path(), e);
+                        }
+                        prefetchedBytes -= numBytes;
+                        finishOutputSlot(slot);
+                    });
+                return;
+            }
         }
-        else
+        catch (const std::exception& e)
         {
-            // Will never get here.
-            return "unknown file type";
+            ignoreError(ctx, prefetched.slot, "Skipping", prefetched.entry.path(), e);
         }
+        finishOutputSlot(prefetched.slot);
     }
 
-    /// Apply all rules.
-    std::string applyAllRules(const std::string& input, size_t* numMatchesOut = nullptr)
+    /// Apply all rules to the contents of a regular file and print verbose output and preview.
+    /// Return the number of matches if the contents changed, else 0 (result is then valid until the next applyContentRules() call on ctx).
+    size_t matchFile(Context& ctx, const std::filesystem::path& path, const ut1::MappedFile& file, std::string_view& result)
     {
-        std::string r = input;
+        ctx.stats.numFilesProcessed++;
+
+        // Apply all rules.
         size_t numMatches = 0;
-        for (Rule& rule: rules)
+        result            = applyContentRules(ctx, file.view(), &numMatches);
+        checkTruncated(path, file);
+
+        // Matches may leave the contents unchanged (foo=foo, rules undoing each other).
+        // The size check makes this free for all other files.
+        bool changed = numMatches && ((result.size() != file.size()) || (result != file.view()));
+        if (!countFile(ctx, path, numMatches, changed))
         {
-            numMatches += applyRule(r, rule);
+            return 0;
         }
-        if (numMatchesOut)
+
+        // Preview.
+        if (preview)
         {
-            *numMatchesOut = numMatches;
+            std::string previewData(result);
+            ut1::addTrailingLfIfMissing(previewData);
+            printPreview(ctx, previewData, path.string(), numMatches);
         }
-        return r;
+        return numMatches;
     }
 
-    /// Process regular file.
-    void processRegularFile(const std::filesystem::directory_entry& directoryEntry)
+    /// Throw if file was truncated while its contents were read (the missing part was read as zero bytes, see ut1::MappedFile::wasTruncated()).
+    static void checkTruncated(const std::filesystem::path& path, const ut1::MappedFile& file)
     {
-        if (!modifyFiles)
+        if (file.wasTruncated())
         {
-            return;
+            throw Error("File " + path.string() + " was truncated while it was read (not modified).");
         }
+    }
 
-        if (verbose >= 2)
+    /// Print verbose output and count a regular file after all rules were applied to its contents.
+    /// Return true iff the contents changed (files which matched but are unchanged are not written, so their mtime stays the same and build systems do not rebuild them).
+    bool countFile(Context& ctx, const std::filesystem::path& path, size_t numMatches, bool changed)
+    {
+        if (numMatches && !changed)
         {
-            std::cout << "Processing " << directoryEntry.path().string() << ut1::flushTty;
+            if (verbose)
+            {
+                ctx.out() << "\rMatched but unchanged " << path.string() << " (" << numMatches << " matches)\n";
+            }
+            ctx.stats.numFilesUnchanged++;
+            return false;
         }
 
-        // Read file.
-        std::string data = ut1::readFile(directoryEntry.path().string());
-        numFilesProcessed++;
-
-        // Apply all rules.
-        size_t numMatches = 0;
-        data = applyAllRules(data, &numMatches);
-
         if (verbose)
         {
             if (numMatches)
             {
-                std::cout << "\rModifying " << directoryEntry.path().string() << " (" << numMatches << " matches)\n";
+                ctx.out() << "\rModifying " << path.string() << " (" << numMatches << " matches)\n";
             }
             else
             {
                 if (verbose >= 2)
                 {
-                    std::cout << "\n";
+                    ctx.out() << "\n";
                 }
             }
         }
 
         if (numMatches)
         {
-            // Write file.
-            numFilesModified++;
-            if (!dummyMode)
+            ctx.stats.numFilesModified++;
+        }
+        else if (ctx.cacheKey)
+        {
+            noMatchCache->add(*ctx.cacheKey);
+        }
+        ctx.cacheKey.reset();
+        return numMatches != 0;
+    }
+
+    /// --window: Apply all rules to a file larger than windowSize in windows of about windowSize bytes and write the result into a temporary file which replaces the file.
+    /// The result of each window is written immediately and the pages of the window are released, so memory use does not depend on the file size.
+    /// Return false without doing anything if the file has to be processed as a whole (small files, files which are not memory mapped or which cannot be replaced, see ut1::TempFile).
+    bool streamRegularFile(Context& ctx, const ut1::DirEntry& directoryEntry, ut1::MappedFile& file)
+    {
+        if ((splitMode == SplitMode::NONE) || (file.size() <= windowSize) || !file.isMapped())
+        {
+            return false;
+        }
+        std::optional<ut1::TempFile> temp;
+        if (!dummyMode)
+        {
+            temp.emplace(directoryEntry.atFd(), directoryEntry.atName());
+            if (!temp->isOpen())
+            {
+                return false;
+            }
+        }
+        ctx.stats.numFilesProcessed++;
+
+        std::string_view s          = file.view();
+        size_t           numMatches = 0;
+        bool             changed    = false;
+        for (size_t pos = 0; pos < s.size();)
+        {
+            size_t           end           = getWindowEnd(s, pos, windowSize);
+            size_t           windowMatches = 0;
+            std::string_view result        = applyWindowRules(ctx, s, pos, end, true, &windowMatches);
+            std::string_view window        = s.substr(pos, end - pos);
+            numMatches += windowMatches;
+            if (windowMatches && !changed && ((result.size() != window.size()) || (result != window)))
+            {
+                // Files are only written from the first change on, so the windows before it are copied now.
+                changed = true;
+                for (size_t copyPos = 0; temp && (copyPos < pos); copyPos += windowSize)
+                {
+                    size_t copyEnd = std::min(copyPos + windowSize, pos);
+                    temp->write(s.substr(copyPos, copyEnd - copyPos));
+                    file.discard(copyEnd);
+                }
+            }
+            if (changed && temp)
+            {
+                temp->write(result);
+            }
+            file.discard(end);
+            pos = end;
+        }
+        checkTruncated(directoryEntry.path(), file);
+
+        if (countFile(ctx, directoryEntry.path(), numMatches, changed) && temp)
+        {
+            makeBackup(ctx, directoryEntry);
+            file.close();
+            fileWriter->replace(directoryEntry, *temp);
+        }
+        return true;
+    }
+
+    /// --window and "-": Get the end of the window of s which starts at pos.
+    /// This is the last position at most size bytes after pos where s can be split without changing the result of applyAllRules() (see splitMode),
+    /// or the first one after that for lines and matches longer than size. complete is true iff s contains all remaining input, so the end of s is a split point.
+    /// With SplitMode::OVERLAP this is only the end of the window and applyWindowRules() finds the split point in it.
+    /// Return npos if there is no split point (only if complete is false).
+    size_t getWindowEnd(std::string_view s, size_t pos, size_t size, bool complete = true) const
+    {
+        if (complete && (s.size() - pos <= size))
+        {
+            return s.size();
+        }
+        size_t end = std::min(pos + size, s.size());
+        if (splitMode == SplitMode::LINES)
+        {
+            // After the last newline in the window, or after the first newline after it for lines longer than the window.
+            size_t newline = s.substr(pos, end - pos).rfind('\n');
+            if (newline != std::string::npos)
+            {
+                return pos + newline + 1;
+            }
+            newline = s.find('\n', end);
+            if (newline != std::string::npos)
+            {
+                return newline + 1;
+            }
+            return complete ? s.size() : std::string::npos;
+        }
+        if (splitMode == SplitMode::OVERLAP)
+        {
+            // The window must be longer than the longest match, since only the matches which start before its last maxMatchLength bytes are replaced.
+            end = std::max(end, pos + maxMatchLength + 1);
+            if (end > s.size())
+            {
+                return complete ? s.size() : std::string::npos;
+            }
+            return end;
+        }
+
+        // Without the rest of the input, split points must leave room for a left side which starts before them.
+        size_t reserve = complete ? 1 : std::max(maxLiteralSize - 1, size_t(1));
+        if (s.size() < pos + 1 + reserve)
+        {
+            return complete ? s.size() : std::string::npos;
+        }
+        size_t last = s.size() - reserve;
+
+        // Usually the end of the window is a split point already. Only input like "aaaa" for rule "aa=b" makes the window larger.
+        for (size_t split = std::min(end, last); split > pos; split--)
+        {
+            if (isLiteralSplitPoint(s, split))
+            {
+                return split;
+            }
+        }
+        for (size_t split = end + 1; split <= last; split++)
+        {
+            if (isLiteralSplitPoint(s, split))
             {
-                ut1::writeFile(directoryEntry.path().string(), data);
+                return split;
             }
+        }
+        return complete ? s.size() : std::string::npos;
+    }
+
+    /// --window and "-": Apply all rules to the window s[pos, end) (see getWindowEnd()). complete is true iff s contains all remaining input.
+    /// With SplitMode::OVERLAP the result may only cover s[pos, end) for a smaller end, where the next window starts.
+    /// Return the result, which is only valid until the next call (see applyContentRules()).
+    std::string_view applyWindowRules(Context& ctx, std::string_view s, size_t pos, size_t& end, bool complete, size_t* numMatchesOut)
+    {
+        std::string_view window = s.substr(pos, end - pos);
+        if ((splitMode != SplitMode::OVERLAP) || (complete && (end == s.size())))
+        {
+            return applyContentRules(ctx, window, numMatchesOut);
+        }
+
+        // Matches which start in the last maxMatchLength bytes of the window may continue after it, so they are left to the next window.
+        // The matches before them end in the window and are the same as in the whole input, since they only depend on the matched text (see Rule::getMaxMatchLength()).
+        const Rule&  rule       = rules[0];
+        size_t       limit      = window.size() - maxMatchLength;
+        size_t       numMatches = 0;
+        size_t       endOfMatch = 0;
+        std::string& r          = ctx.buffers[0];
+        r.clear();
+        rule.dfa->forEachMatch(window, ctx.dfaCaches[0], [&](const ut1::DfaRegex::Match& match)
+            {
+                if (match.position() >= limit)
+                {
+                    return;
+                }
+                r.append(window, endOfMatch, match.position() - endOfMatch);
+                appendReplacement(r, window, endOfMatch, match.position(), match.end(), rule, [&](size_t group)
+                    { return ((group < match.size()) && match.matched(group)) ? window.substr(match.position(group), match.length(group)) : std::string_view(); }, numMatches);
+                endOfMatch = match.end();
+            });
+        size_t windowEnd = std::max(endOfMatch, limit);
+        end              = pos + windowEnd;
+        ctx.numMatches[0] += numMatches;
+        if (numMatchesOut)
+        {
+            *numMatchesOut = numMatches;
+        }
+        if (!numMatches)
+        {
+            return window.substr(0, windowEnd);
+        }
+        r.append(window, endOfMatch, windowEnd - endOfMatch);
+        return r;
+    }
 
-            // Preview.
-            if (preview)
+    /// --window: Return true iff no left side of a literal rule occurs in s across position split (0 < split < s.size()),
+    /// so all matches are on one side of split. With --whole-words split must not be inside a word (a match ending there would not be a whole word).
+    bool isLiteralSplitPoint(std::string_view s, size_t split) const
+    {
+        if (wholeWords && ut1::isalnum_(s[split - 1]) && ut1::isalnum_(s[split]))
+        {
+            return false;
+        }
+        for (const Rule& rule: rules)
+        {
+            // Each occurrence in s[split - len + 1, split + len - 1) contains s[split - 1] and s[split].
+            size_t len   = rule.literal->size();
+            size_t begin = split - std::min(split, len - 1);
+            if (rule.literal->find(s.substr(begin, std::min(split + len - 1, s.size()) - begin)) != std::string::npos)
             {
-                ut1::addTrailingLfIfMissing(data);
-                printPreview(data, directoryEntry.path().string(), numMatches);
+                return false;
             }
         }
+        return true;
+    }
+
+    /// Get description of splitMode.
+    const char* getSplitModeStr() const
+    {
+        switch (splitMode)
+        {
+        case SplitMode::LINES: return "after newlines";
+        case SplitMode::LITERALS: return "between literal matches";
+        case SplitMode::OVERLAP: return "overlapping by the longest match";
+        default: return "none (files are processed as a whole)";
+        }
     }
 
     /// Process symlink.
-    void processSymlink(const std::filesystem::directory_entry& directoryEntry)
+    void processSymlink(Context& ctx, const ut1::DirEntry& directoryEntry)
     {
         if (modifySymlinks)
         {
             if (verbose >= 2)
             {
-                std::cout << "Processing symlink " << directoryEntry.path().string() << ".\n";
+                ctx.out() << "Processing symlink " << directoryEntry.path().string() << ".\n";
             }
-            std::string oldp = std::filesystem::read_symlink(directoryEntry);
-            std::string newp = applyAllRules(oldp);
+            std::string oldp = directoryEntry.readSymlink();
+            std::string newp(applyAllRules(ctx, oldp));
             if (newp != oldp)
             {
                 if (verbose)
                 {
-                    std::cout << "Modifying symlink target of " << directoryEntry.path().string() << ": " << oldp << " -> " << newp << ".\n";
+                    ctx.out() << "Modifying symlink target of " << directoryEntry.path().string() << ": " << oldp << " -> " << newp << ".\n";
                 }
                 if (!dummyMode)
                 {
-                    std::filesystem::remove(directoryEntry);
-                    std::filesystem::create_symlink(newp, directoryEntry);
+                    directoryEntry.replaceSymlink(newp);
                 }
-                numSymlinksModified++;
+                ctx.stats.numSymlinksModified++;
             }
-            numSymlinksProcessed++;
+            ctx.stats.numSymlinksProcessed++;
         }
         else
         {
             if (verbose >= 2)
             {
-                std::cout << "Ignoring symlink " << directoryEntry.path() << ".\n";
+                ctx.out() << "Ignoring symlink " << directoryEntry.path() << ".\n";
             }
-            numIgnored++;
+            ctx.stats.numIgnored++;
         }
     }
 
     /// Process directory.
-    void processDirectory(const std::filesystem::directory_entry& directoryEntry)
+    /// The output of each entry goes into a new child slot of slot.
+    void processDirectory(Context& ctx, const ut1::DirEntry& directoryEntry, const ut1::OrderedOutput::SlotPtr& slot)
     {
         if (recursive && (!skipDir(directoryEntry.path())))
         {
-            if (verbose >= 2)
-            {
-                std::cout << "Processing dir " << directoryEntry.path().string() << ".\n";
-            }
-
-            // Note: Take a copy of each directory_entry intentionally,
-            // because we will potentially modify it (rename) in processDirectoryEntry.
+            // Note: The directory is read completely before processing any entry,
+            // so renaming entries (in processDirectoryEntry) cannot confuse the directory iteration.
+            std::vector<ut1::DirEntry> entries;
             try
             {
-                for (std::filesystem::directory_entry entry: std::filesystem::directory_iterator(directoryEntry))
+                entries = directoryEntry.readDirectory();
+                if (verbose >= 2)
+                {
+                    ctx.out() << "Processing dir " << directoryEntry.path().string() << ".\n";
+                }
+                for (ut1::DirEntry& entry: entries)
                 {
-                    processDirectoryEntry(entry);
+                    processDirectoryEntry(ctx, entry, createOutputSlot(slot));
                 }
             }
             catch (const std::exception& e)
             {
-                if (!ignoreErrors)
-                {
-                    throw;
-                }
-                if (verbose)
+                if (entries.empty() && isTooManyOpenFiles(e))
                 {
-                    std::cerr << "Skipping dir " << directoryEntry.path().string() << ": " << e.what() << "\n";
+                    throw; // Not listed yet: Retried by runOrDefer().
                 }
-                numIgnored++;
+                ignoreError(ctx, slot, "Skipping dir", directoryEntry.path(), e);
                 return;
             }
 
-            numDirsProcessed++;
+            ctx.stats.numDirsProcessed++;
         }
         else
         {
-            std::cout << "Ignoring dir " << directoryEntry.path().string() << ".\n";
-            numIgnored++;
+            ctx.out() << "Ignoring dir " << directoryEntry.path().string() << ".\n";
+            ctx.stats.numIgnored++;
         }
     }
 
     /// Process non-file, non-dir and non-symlinks.
-    void processOther(const std::filesystem::directory_entry& directoryEntry)
+    void processOther(Context& ctx, const ut1::DirEntry& directoryEntry)
     {
         if (verbose)
         {
-            std::cout << "Ignoring " << getFileTypeStr(directoryEntry) << " " << directoryEntry.path().string() << ".\n";
+            ctx.out() << "Ignoring " << getFileTypeStr(directoryEntry) << " " << directoryEntry.path().string() << ".\n";
         }
-        numIgnored++;
+        ctx.stats.numIgnored++;
     }
 
     /// Return true iff we should skip this dir.
@@ -539,58 +1919,176 @@ private:
         return onlyExts.find(ext) != onlyExts.end();
     }
 
-    /// Replace single match.
-    std::string replaceMatch(const std::smatch& match, Rule& rule, size_t& numMatches)
+    /// Return true iff the match [pos, pos + len) in s starts or ends in the middle of a word (for --whole-words).
+    static bool isPartialWord(std::string_view s, size_t pos, size_t len)
+    {
+        if (len == 0)
+        {
+            return false;
+        }
+        return (ut1::isalnum_(s[pos]) && (pos > 0) && ut1::isalnum_(s[pos - 1])) || (ut1::isalnum_(s[pos + len - 1]) && (pos + len < s.size()) && ut1::isalnum_(s[pos + len]));
+    }
+
+    /// Append replacement for the match s[matchStart, matchEnd) to out (highlighted for --preview) and count match.
+    /// group(n) returns the string of group n.
+    template<typename Group>
+    void appendReplacement(std::string& out, std::string_view s, size_t prefixPos, size_t matchStart, size_t matchEnd, const Rule& rule, Group group, size_t& numMatches)
     {
         // --whole-words
-        if (wholeWords && match.length())
+        if (wholeWords && isPartialWord(s, matchStart, matchEnd - matchStart))
         {
-            if ((ut1::isalnum_(match.str()[0]) && match.prefix().length() && ut1::isalnum_(match.prefix().str().back())) || (ut1::isalnum_(match.str().back()) && match.suffix().length() && ut1::isalnum_(match.suffix().str()[0])))
-            {
-                // Ignore match, return original string.
-                return match.str();
-            }
+            // Ignore match, keep original string.
+            out.append(s, matchStart, matchEnd - matchStart);
+            return;
         }
 
-        // Format according to rhs and return replacement string.
-        std::string fmt = rule.rhs;
-        if (dollar != "$")
+        if (preview)
         {
-            ut1::replaceStringInPlace(fmt, "$", "$$");
-            ut1::replaceStringInPlace(fmt, dollar, "$");
+            out += escapeSequences.bold;
         }
-        std::string r = match.format(fmt);
+        rule.replacement.expand(out, s, prefixPos, matchStart, matchEnd, group);
         if (preview)
         {
-            r = escapeSequences.bold + r + escapeSequences.normal;
+            out += escapeSequences.normal;
         }
         numMatches++;
-        return r;
     }
 
-    /// Apply rule to string.
-    /// Return number of matches.
-    /// Increase rule.numMatches.
-    uint64_t applyRule(std::string& s, Rule& rule)
+    /// Append replacement for a literal match s[matchStart, matchEnd) to out.
+    void appendLiteralReplacement(std::string& out, std::string_view s, size_t prefixPos, size_t matchStart, size_t matchEnd, const Rule& rule, size_t& numMatches)
+    {
+        appendReplacement(out, s, prefixPos, matchStart, matchEnd, rule, [&](size_t group)
+            { return (group == 0) ? s.substr(matchStart, matchEnd - matchStart) : std::string_view(); }, numMatches);
+    }
+
+    /// Append replacement for a std::regex match in s to out.
+    void appendRegexReplacement(std::string& out, std::string_view s, const std::cmatch& match, const Rule& rule, size_t& numMatches)
+    {
+        size_t matchStart = size_t(match.position(0));
+        appendReplacement(out, s, size_t(match.prefix().first - s.data()), matchStart, matchStart + size_t(match.length(0)), rule, [&](size_t group)
+            { return ((group < match.size()) && match[group].matched) ? s.substr(size_t(match.position(group)), size_t(match.length(group))) : std::string_view(); }, numMatches);
+    }
+
+    /// Reserve output buffer for replacing matches in s (called on the first match).
+    static void reserveOutput(std::string& out, std::string_view s)
+    {
+        // Most replacements have a similar length as the original.
+        out.reserve(s.size() + s.size() / 8);
+    }
+
+    /// Apply literal rule to string s and write the result to r.
+    /// Return number of matches (r is not written if there are no matches).
+    uint64_t applyLiteralRule(std::string_view s, std::string& r, const Rule& rule)
+    {
+        size_t pos = rule.literal->find(s);
+        if (pos == std::string::npos)
+        {
+            return 0;
+        }
+        size_t numMatches = 0;
+        size_t endOfMatch = 0;
+        reserveOutput(r, s);
+        for (; pos != std::string::npos; pos = rule.literal->find(s, endOfMatch))
+        {
+            r.append(s, endOfMatch, pos - endOfMatch);
+            appendLiteralReplacement(r, s, endOfMatch, pos, pos + rule.literal->size(), rule, numMatches);
+            endOfMatch = pos + rule.literal->size();
+        }
+        r.append(s, endOfMatch);
+        return numMatches;
+    }
+
+    /// Apply DFA rule to string s and write the result to r.
+    /// Return number of matches (r is not written if there are no matches).
+    uint64_t applyDfaRule(std::string_view s, std::string& r, const Rule& rule, ut1::DfaRegex::Cache& cache)
     {
         size_t numMatches = 0;
+        size_t endOfMatch = 0;
+        bool   found      = false;
+        rule.dfa->forEachMatch(s, cache, [&](const ut1::DfaRegex::Match& match)
+            {
+                if (!found)
+                {
+                    reserveOutput(r, s);
+                    found = true;
+                }
+                r.append(s, endOfMatch, match.position() - endOfMatch);
+                appendReplacement(r, s, endOfMatch, match.position(), match.end(), rule, [&](size_t group)
+                    { return ((group < match.size()) && match.matched(group)) ? s.substr(match.position(group), match.length(group)) : std::string_view(); }, numMatches);
+                endOfMatch = match.end();
+            });
+        if (found)
+        {
+            r.append(s, endOfMatch);
+        }
+        return numMatches;
+    }
+
+    /// Apply all literal rules to string in a single pass using multiLiteral.
+    /// At each position the leftmost-longest match of all rules is replaced.
+    /// The result is written to r.
+    /// Return number of matches (r is not written if there are no matches).
+    uint64_t applyMultiLiteralRules(Context& ctx, std::string_view s, std::string& r)
+    {
+        size_t                 numMatches = 0;
+        size_t                 endOfMatch = 0;
+        ut1::AhoCorasick::Match match;
+        auto accept = [&](size_t pos, size_t len, size_t) { return !(wholeWords && isPartialWord(s, pos, len)); };
+        while (multiLiteral->findLeftmostLongest(s, endOfMatch, match, accept))
+        {
+            const Rule& rule     = rules[match.pattern];
+            size_t ruleNumMatches = 0;
+            if (endOfMatch == 0)
+            {
+                reserveOutput(r, s);
+            }
+            r.append(s, endOfMatch, match.pos - endOfMatch);
+            appendLiteralReplacement(r, s, endOfMatch, match.pos, match.pos + match.len, rule, ruleNumMatches);
+            ctx.numMatches[match.pattern] += ruleNumMatches;
+            numMatches += ruleNumMatches;
+            endOfMatch = match.pos + match.len;
+        }
+        if (endOfMatch != 0)
+        {
+            r.append(s, endOfMatch);
+        }
+        return numMatches;
+    }
+
+    /// Apply rule to string s and write the result to r.
+    /// Return number of matches (r must not be used if there are no matches).
+    /// Count the matches of the rule in ctx.
+    uint64_t applyRule(Context& ctx, std::string_view s, std::string& r, size_t ruleIndex)
+    {
+        const Rule& rule       = rules[ruleIndex];
+        size_t      numMatches = 0;
 
-        s = ut1::regex_replace(s, std::regex(rule.lhs, regexFlags), [&](const std::smatch& match)
-            { return replaceMatch(match, rule, numMatches); });
+        if (rule.isLiteral())
+        {
+            numMatches = applyLiteralRule(s, r, rule);
+        }
+        else if (rule.isDfa())
+        {
+            numMatches = applyDfaRule(s, r, rule, ctx.dfaCaches[ruleIndex]);
+        }
+        else
+        {
+            ut1::regex_replace(r, s, rule.regex, [&](std::string& out, const std::cmatch& match) { appendRegexReplacement(out, s, match, rule, numMatches); });
+        }
 
-        rule.numMatches += numMatches;
+        ctx.numMatches[ruleIndex] += numMatches;
         return numMatches;
     }
 
     /// Print preview.
-    void printPreview(const std::string& s, const std::string& filename, size_t numMatches)
+    void printPreview(Context& ctx, const std::string& s, const std::string& filename, size_t numMatches)
     {
-        std::cout << escapeSequences.bold << filename << escapeSequences.normal << " (" << escapeSequences.bold << numMatches << escapeSequences.normal << " match" + ut1::pluralS(numMatches, "es") + "):\n";
+        ctx.out() << escapeSequences.bold << filename << escapeSequences.normal << " (" << escapeSequences.bold << numMatches << escapeSequences.normal << " match" + ut1::pluralS(numMatches, "es") + "):\n";
 
         if (context == -1)
         {
             // Print whole file.
-            std::cout << s;
+            ctx.out() << s;
         }
         else
         {
@@ -618,11 +2116,11 @@ private:
             {
                 if ((!previewHideSep) && (marked[line] && ((line == 0) || (!marked[line - 1]))))
                 {
-                    std::cout << escapeSequences.thin << "--" << line + 1 << "--" << escapeSequences.normal << "\n";
+                    ctx.out() << escapeSequences.thin << "--" << line + 1 << "--" << escapeSequences.normal << "\n";
                 }
                 if (marked[line])
                 {
-                    std::cout << lines[line] << "\n";
+                    ctx.out() << lines[line] << "\n";
                 }
             }
         }
@@ -637,6 +2135,7 @@ private:
     bool followLinks{};
     bool all{};
     bool ignoreErrors{};
+    unsigned numJobs{};
 
     unsigned verbose{};
     bool     dummyMode{};
@@ -648,30 +2147,112 @@ private:
     bool modifyFiles{};
     bool rename{};
     bool modifySymlinks{};
+    bool restore{};
+
+    /// Backups.
+    bool        backup{};
+    std::string backupSuffix;
 
     /// Matching options.
     std::vector<Rule>     rules;
+    std::optional<ut1::AhoCorasick> multiLiteral;
     std::regex::flag_type regexFlags{};
     bool ignoreCase{};
     bool noRegex{};
+    bool useDfa{};
     bool wholeWords{};
     std::string equals;
     std::string dollar;
     std::set<std::string> onlyExts;
 
-    /// Statistics.
-    uint64_t numIgnored{};
-    uint64_t numFilesProcessed{};
-    uint64_t numFilesModified{};
-    uint64_t numFilesRenamed{};
-    uint64_t numFilesConsideredForRename{};
-    uint64_t numSymlinksProcessed{};
-    uint64_t numSymlinksModified{};
-    uint64_t numDirsProcessed{};
-    uint64_t numDirsRenamed{};
-    uint64_t numDirsConsideredForRename{};
+    /// --select-lines/--ignore-lines: Regex which selects the lines the rules are applied to (the lines not matching it with --ignore-lines).
+    /// Lines which do not contain lineFilterPrefilter cannot match.
+    std::string                         lineFilter;
+    bool                                ignoreLines{};
+    std::optional<ut1::DfaRegex>        lineFilterDfa;
+    std::optional<std::regex>           lineFilterRegex;
+    std::optional<ut1::LiteralSearcher> lineFilterPrefilter;
+
+    /// Statistics (merged from all contexts after processing).
+    Stats    stats;
 
     EscapeSequences escapeSequences;
+
+    /// Per-thread state: contexts[0] is used by the main thread, contexts[i + 1] by worker thread i.
+    std::vector<Context> contexts;
+
+    /// --prefetch: Pipeline of files which are read ahead by fileReader (oldest first) and written by writePool.
+    /// prefetchedBytes counts the data of read files which are not matched yet plus the data which is not written yet.
+    struct PrefetchedFile
+    {
+        ut1::DirEntry                 entry;
+        ut1::OrderedOutput::SlotPtr   slot;
+        std::future<ut1::MappedFile> file;
+        std::optional<ut1::NoMatchCache::Key> cacheKey;
+    };
+    static constexpr unsigned  kMaxPrefetchThreads = 8;
+    unsigned                   prefetchDepth{};
+    ut1::IoEngine              ioEngine{};
+    bool                       ioFallback{};
+
+    size_t                     prefetchMemory{};
+    std::deque<PrefetchedFile> prefetchQueue;
+    std::atomic<size_t>        prefetchedBytes{};
+
+    /// Writes all modified files (--atomic, --fsync).
+    std::optional<ut1::FileWriter> fileWriter;
+
+    /// --window: Where files are split into windows.
+    enum class SplitMode { NONE, LINES, LITERALS, OVERLAP };
+    size_t    windowSize{};
+    SplitMode splitMode{};
+    size_t    maxLiteralSize{}; ///< Longest left side for SplitMode::LITERALS.
+    size_t    maxMatchLength{}; ///< Longest match of the rule for SplitMode::OVERLAP.
+    static constexpr const char* kNoSplitReason = "the rules can match across lines and are not a single regex whose matches are bounded in length (see --window)";
+
+    /// No-match cache (--no-cache, --cache-file, --cache-size).
+    bool                             useCache{};
+    std::string                      cacheFile;
+    size_t                           cacheSize{};
+    std::optional<ut1::NoMatchCache> noMatchCache;
+
+    /// "-": Size of the blocks read from stdin (unless --window is specified).
+    static constexpr size_t kStdinBlockSize = 1024 * 1024;
+
+    /// --line-mode: Rules are applied to each line separately. allLineLocal: All rules give the same result for the whole contents (see Rule::isLineLocal()).
+    bool                   lineMode{};
+    bool                   allLineLocal{};
+    ut1::LiteralSearcher   newlineSearcher{"\n"};
+
+    /// --line-mode with --jobs: Files larger than kChunkSize are split into chunks at line boundaries which are matched by chunkPool (using chunkContexts[worker]).
+    static constexpr size_t kChunkSize = 1024 * 1024;
+    std::vector<Context>    chunkContexts;
+
+    /// Bounds of the queues of files and dirs waiting for a worker thread (per --jobs thread).
+    /// They are reduced if the limit of open files (raised up to kMaxOpenFiles) minus the reserved fds is lower.
+    static constexpr size_t kQueuedFilesPerJob = 64;
+    static constexpr size_t kQueuedDirsPerJob  = 16;
+    static constexpr size_t kMaxOpenFiles      = 65536;
+    static constexpr size_t kReservedFds       = 64;
+    static constexpr size_t kReservedFdsPerJob = 32;
+
+    /// Maximum number of attempts to open a file or dir while too many files are open (see runOrDefer()).
+    static constexpr unsigned kMaxOpenRetries = 500;
+
+    /// --jobs: Ordered output and thread pool (declared last so the worker threads are joined first).
+    /// Directories are listed and files are processed by the pool.
+    /// At most maxQueuedFiles files and maxQueuedDirs dirs are queued, further entries are processed by the thread which discovers them.
+    /// Nothing is queued anymore once opening a file or dir failed because too many files were open (tooManyOpenFiles).
+    std::optional<ut1::OrderedOutput>   output;
+    std::atomic<size_t>                 numQueuedFiles{};
+    size_t                              maxQueuedFiles{};
+    std::atomic<size_t>                 numQueuedDirs{};
+    size_t                              maxQueuedDirs{};
+    std::atomic<bool>                   tooManyOpenFiles{};
+    std::optional<ut1::ThreadPool>      pool;
+    std::optional<ut1::AsyncFileReader> fileReader;
+    std::optional<ut1::ThreadPool>      writePool;
+    std::optional<ut1::ThreadPool>      chunkPool;
 };
 
 
@@ -684,6 +2265,7 @@ int main(int argc, char* argv[])
     ut1::CommandLineParser cl("streplace", "Replace strings in files, filenames and symbolic links, in place, recursively.\n"
                                            "\n"
                                            "Usage: $programName [OPTIONS, FILES, DIRS and RULES] [--] [FILES and DIRS]\n"
+                                           "   or: $programName [OPTIONS and RULES] -   (filter stdin to stdout)\n"
                                            "\n"
                                            "This program substitutes strings in files, filenames and symbolic links according to rules:\n"
                                            "- A rule is of the from FOO=BAR which replaces FOO by BAR. FOO is a regular expression by default (unless -x is specified).\n"
@@ -703,10 +2285,27 @@ int main(int argc, char* argv[])
     cl.addOption('C', "c-only", "Process only C/C++ related file extensions.");
     cl.addOption('E', "ignore-errors", "Skip files/directories that can't be read/written/renamed.");
     cl.addOption(' ', "all", "Process all files and directories. By default '.git' directories are skipped.");
+    cl.addOption(' ', "prefetch", "Pipeline file I/O without --jobs: Read up to N files ahead in background threads while matching and write modified files in a background thread (0 = off). This hides I/O latency on slow disks and network filesystems.", "N", "0");
+    cl.addOption(' ', "prefetch-memory", "Limit the data of files which are read ahead or waiting to be written by --prefetch to about MB megabytes.", "MB", "256");
+    cl.addOption('b', "backup", "Copy each file to a backup file (FILE + suffix) before it is modified, unless the backup file already exists. The copy is a reflink (sharing the data with the original) on filesystems which support it (btrfs, XFS), else an in-kernel copy_file_range(). Files ending with the backup suffix are never processed.");
+    cl.addOption('S', "suffix", "Set the backup suffix to SUF.", "SUF", ".~sub~");
+    cl.addOption(' ', "restore", "Restore all files which have a backup file from their backup (undoes all content changes, but not renames). The backup files are removed. No rules are allowed.");
+    cl.addOption(' ', "atomic", "Replace modified files atomically: Write the new contents to a temporary file in the same directory (with the mode and owner of the original) and rename it over the original, so readers never see partially written files and a crash leaves either the old or the new file. Symlinks and files with multiple hardlinks are still written in place.");
+    cl.addOption(' ', "fsync", "Sync modified files to disk: 0 = never, 1 = each file (with --atomic before it replaces the original), N = once per N files (with --atomic the originals are replaced after the sync).", "N", "0");
+    cl.addOption(' ', "no-cache", "Do not use the no-match cache. The cache records files which contain no match for the left sides of the rules (by device, inode, size, mtime and ctime), so they are skipped without being read when the same rules are applied again. The cache is only used when files are modified (not with --dummy-mode, --preview, --rename-only or --modify-symlinks).");
+    cl.addOption(' ', "cache-file", "No-match cache file (default: $XDG_CACHE_HOME/streplace/no-match-cache or ~/.cache/streplace/no-match-cache).", "FILE");
+    cl.addOption(' ', "cache-size", "Limit the no-match cache to about MB megabytes (40 bytes per file), the oldest entries are dropped.", "MB", "64");
+    cl.addOption(' ', "window", "Process files larger than MB megabytes in windows of about MB megabytes, so memory use is bounded for files of any size (0 = off). The new contents are written to a temporary file which replaces the file, like --atomic (symlinks and files with multiple hardlinks are processed as a whole). Windows end after a newline if no rule can match a newline, ^, $ or an empty string (regex rules with syntax not supported by the 'dfa' engine never qualify). With --no-regex windows end where no left side can match across the end, so there is no such restriction. A single regex rule which can match a newline but whose matches are bounded in length (e.g. 'a\\sb', but not 'a\\s*b', ^, $ or \\b) uses windows which overlap by its longest match. Otherwise files are processed as a whole (with a warning). Ignored with --preview.", "MB", "0");
+    cl.addOption(' ', "io", "I/O engine for reading files with --prefetch: auto, posix or io_uring. io_uring (Linux) opens, stat()s and reads many small files with few syscalls. auto and io_uring fall back to posix if io_uring is not available. Modified files are always written with POSIX I/O.", "ENGINE", "auto");
+    cl.addOption('j', "jobs", "Process the contents of files in N parallel threads (0 = number of CPUs). The output is the same as for a single thread.", "N", "1");
 
     cl.addHeader("\nMatching options:\n");
     cl.addOption('i', "ignore-case", "Ignore case.");
-    cl.addOption('x', "no-regex", "Match the left side of each rule as a simple string, not as a regex (substring search, useful with binary files).");
+    cl.addOption('x', "no-regex", "Match the left side of each rule as a simple string, not as a regex (substring search, useful with binary files). Multiple rules are applied simultaneously in a single pass: At each position the leftmost-longest left side of all rules is replaced (the first rule wins for identical left sides) and replacements are not matched again by other rules.");
+    cl.addOption(' ', "engine", "Regex engine: 'dfa' (default, linear-time engine with constant stack usage, so large single-line files work) or 'std' (std::regex, which may crash with a stack overflow on long matches, e.g. '.*' on a multi-megabyte line). Rules using syntax not supported by 'dfa' (e.g. backreferences or lookahead) automatically fall back to 'std' (shown with -vv).", "ENGINE", "dfa");
+    cl.addOption(' ', "select-lines", "Apply the rules only to lines matching regex R (implies --line-mode). Lines which do not contain a literal required by R are skipped without matching R.", "R");
+    cl.addOption(' ', "ignore-lines", "Apply the rules only to lines not matching regex R (implies --line-mode).", "R");
+    cl.addOption(' ', "line-mode", "Apply the rules to each line separately (without its newline), so ^ and $ match at the start and end of each line and matches never span lines. With --jobs files larger than 1 MB are split into chunks of lines which are matched in parallel. With --window or '-' the windows always end after a newline.");
     cl.addOption('w', "whole-words", "Match only whole words. A word is an alphanumeric seuqnece with underscores. If the match begins/ends with a non-word char then this is always considered to be a word boundary, e.g. 'foo;' matches '::foo;' but not 'barfoo;'.");
     cl.addOption(' ', "equals", "Use STR instead of \"=\" as the rule lhs/rhs-separator, e.g. fooSTRbar. This may be one or more chars long. Example: --equals==== allows rules to have the form \"int a = 0;===unsigned a = 0;\"", "STR", "=");
     cl.addOption(' ', "dollar", "Use STR instead of \"$\" in substring references in the replacement string, e.g. STR&, STR1, STR12. This may be one or more chars long. Example: --dollar=SUB for \"0x([0-9A-Za-z]+)=$SUB1\"", "STR", "$");
@@ -731,8 +2330,9 @@ int main(int argc, char* argv[])
         Streplace streplace(cl);
 
         // Parse non-option arguments (paths and rules).
-        std::vector<std::filesystem::directory_entry> paths;
+        std::vector<ut1::DirEntry> paths;
         bool                                          allowRules = true;
+        bool                                          useStdin   = false;
         for (const std::string& arg: cl.getArgs())
         {
             if (arg.empty())
@@ -748,6 +2348,10 @@ int main(int argc, char* argv[])
             {
                 allowRules = false;
             }
+            else if (allowRules && (arg == "-"))
+            {
+                useStdin = true;
+            }
             else if (std::filesystem::exists(arg))
             {
                 paths.emplace_back(arg);
@@ -758,10 +2362,33 @@ int main(int argc, char* argv[])
             }
         }
 
-        if (!streplace.hasRules())
+        if (streplace.isRestoreMode())
+        {
+            if (streplace.hasRules())
+            {
+                cl.error("Rules are not allowed with --restore.");
+            }
+        }
+        else if (!streplace.hasRules())
         {
             cl.error("Please specify at least one rule.");
         }
+        if (useStdin && !paths.empty())
+        {
+            cl.error("'-' cannot be combined with files or directories.");
+        }
+        if (useStdin && !streplace.canProcessStdin())
+        {
+            cl.error("'-' cannot be combined with --rename, --rename-only, --modify-symlinks or --restore.");
+        }
+        streplace.compileRules();
+
+        // "-": The data goes to stdout, so all messages go to stderr.
+        std::streambuf* stdoutBuffer = nullptr;
+        if (useStdin)
+        {
+            stdoutBuffer = std::cout.rdbuf(std::cerr.rdbuf());
+        }
 
         // Print rules.
         if (cl.getCount("verbose") >= 2)
@@ -769,10 +2396,14 @@ int main(int argc, char* argv[])
             streplace.printRules();
         }
 
-        // Process files and directories.
-        for (std::filesystem::directory_entry path: paths)
+        // Process files and directories or stdin.
+        if (useStdin)
+        {
+            streplace.processStdin();
+        }
+        else
         {
-            streplace.processDirectoryEntry(path);
+            streplace.processPaths(paths);
         }
 
         // Print stats.
@@ -780,6 +2411,10 @@ int main(int argc, char* argv[])
         {
             streplace.printStats();
         }
+        if (stdoutBuffer)
+        {
+            std::cout.rdbuf(stdoutBuffer);
+        }
     }
     catch (const std::exception& e)
     {
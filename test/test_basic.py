@@ -2,11 +2,19 @@ from __future__ import annotations
 
 import os
 from pathlib import Path
+import re
 import subprocess
+import time
 
 import pytest
 
 
+@pytest.fixture(autouse=True)
+def _isolated_cache(tmp_path_factory: pytest.TempPathFactory, monkeypatch: pytest.MonkeyPatch) -> None:
+    # The no-match cache must not be read from or written to the cache directory of the user running the tests.
+    monkeypatch.setenv("XDG_CACHE_HOME", str(tmp_path_factory.mktemp("xdg-cache")))
+
+
 def streplace_bin() -> Path:
     repo_root = Path(__file__).resolve().parents[1]
     return Path(os.environ.get("STREPLACE_BIN", repo_root / "streplace"))
@@ -431,3 +439,646 @@ def test_modify_symlink_target(tmp_path: Path) -> None:
     run_streplace(["-s", "foo=bar", str(link)], streplace.parent)
     assert os.readlink(link) == "bar.txt"
     assert target.read_text(encoding="utf-8") == "foo\n"
+
+
+@pytest.mark.parametrize("extra", [[], ["--engine", "std"], ["-j", "3"], ["--prefetch", "2"]])
+def test_regex_compiled_once_per_rule(tmp_path: Path, extra: list[str]) -> None:
+    streplace = streplace_bin()
+    for i in range(20):
+        (tmp_path / f"f{i}.txt").write_text("foo\n", encoding="utf-8")
+
+    # The counter is incremented where the regexes are compiled, so compiling per file would show up here.
+    result = run_streplace(["-v", "-v", "-r"] + extra + ["foo=bar", "o+=x", "(a)\\1=y", str(tmp_path)], streplace.parent)
+    assert "3 regexes compiled for 3 rules" in result.stdout
+    assert "20/20 files modified" in result.stdout
+
+
+def test_error_on_invalid_regex(tmp_path: Path) -> None:
+    streplace = streplace_bin()
+    target = tmp_path / "t.txt"
+    target.write_text("foo\n", encoding="utf-8")
+
+    result = run_streplace_result(["fo(o=bar", str(target)], streplace.parent)
+    assert result.returncode != 0
+    assert "Invalid regex" in result.stdout
+    assert target.read_text(encoding="utf-8") == "foo\n"
+
+
+def test_no_regex_ignore_case_long_input(tmp_path: Path) -> None:
+    streplace = streplace_bin()
+    target = tmp_path / "t.txt"
+    target.write_text("x" * 100 + "FoO.bar " + "y" * 100 + "foo.BAR\n", encoding="utf-8")
+
+    run_streplace(["-x", "-i", "foo.bar=$&!", str(target)], streplace.parent)
+    assert target.read_text(encoding="utf-8") == "x" * 100 + "FoO.bar! " + "y" * 100 + "foo.BAR!\n"
+
+
+def test_no_regex_binary_whole_words(tmp_path: Path) -> None:
+    streplace = streplace_bin()
+    target = tmp_path / "t.bin"
+    target.write_bytes(b"\x00\xffab foo afoo foo_ foo\x00")
+
+    run_streplace(["-x", "-w", "foo=bar", str(target)], streplace.parent)
+    assert target.read_bytes() == b"\x00\xffab bar afoo foo_ bar\x00"
+
+
+def test_no_regex_multiple_rules_single_pass(tmp_path: Path) -> None:
+    streplace = streplace_bin()
+    target = tmp_path / "t.txt"
+    target.write_text("a b ab abc\n", encoding="utf-8")
+
+    result = run_streplace(["-x", "-v", "-v", "a=b", "b=a", "abc=X", str(target)], streplace.parent)
+    assert target.read_text(encoding="utf-8") == "b a ba X\n"
+    assert "(5 matches)" in result.stdout
+
+
+def test_engine_dfa_matches_std_regex(tmp_path: Path) -> None:
+    streplace = streplace_bin()
+    content = "foo123 bar_42 x:1;\nFOO7 foofoo\n"
+    expected = None
+    for engine in ["std", "dfa"]:
+        target = tmp_path / f"{engine}.txt"
+        target.write_text(content, encoding="utf-8")
+        run_streplace([f"--engine={engine}", "-i", "(fo+|ba(r))_?([0-9]*)=<$1|$2|$3|$&>", r"\b(x):(\d)=$2:$1", "a*=-", str(target)], streplace.parent)
+        if expected is None:
+            expected = target.read_text(encoding="utf-8")
+        else:
+            assert target.read_text(encoding="utf-8") == expected
+
+
+def test_engine_dfa_falls_back_for_backreferences(tmp_path: Path) -> None:
+    streplace = streplace_bin()
+    target = tmp_path / "t.txt"
+    target.write_text("abab cdcd xy\n", encoding="utf-8")
+
+    result = run_streplace(["--engine=dfa", "-v", "-v", r"(..)\1=$1", str(target)], streplace.parent)
+    assert target.read_text(encoding="utf-8") == "ab cd xy\n"
+    assert "(std::regex:" in result.stdout
+
+
+def test_engine_invalid(tmp_path: Path) -> None:
+    streplace = streplace_bin()
+    target = tmp_path / "t.txt"
+    target.write_text("foo\n", encoding="utf-8")
+
+    result = run_streplace_result(["--engine=pcre", "foo=bar", str(target)], streplace.parent)
+    assert result.returncode != 0
+    assert "--engine" in result.stdout
+
+
+def test_large_single_line_file(tmp_path: Path) -> None:
+    # std::regex recurses once per matched char and overflows the stack on such input.
+    streplace = streplace_bin()
+    target = tmp_path / "bundle.js"
+    half = 25 * 1024 * 1024
+    target.write_bytes(b'var s="' + b"x" * half + b'";' + b"y" * half + b"END")
+
+    run_streplace(['"[^"]*"=""', "y.*END=$&!", str(target)], streplace.parent)
+    data = target.read_bytes()
+    assert data.startswith(b'var s="";yyy')
+    assert data.endswith(b"yEND!")
+    assert len(data) == 10 + half + 3
+
+
+def test_default_engine_many_matches_on_one_line(tmp_path: Path) -> None:
+    # Minified files have a match every few bytes on one line: The default engine must stay linear and agree with std::regex.
+    streplace = streplace_bin()
+    content = 'var a1="x",b22=f(a1);' * 100000 + "\n"
+    rules = [r"\b([a-z])([0-9]+)\b=$2$1", '"[^"]*"=""', r"f\(=g("]
+    expected = None
+    for engine in [[], ["--engine=std"]]:
+        target = tmp_path / f"min{len(engine)}.js"
+        target.write_text(content, encoding="utf-8")
+        start = time.perf_counter()
+        run_streplace(engine + rules + [str(target)], streplace.parent)
+        if not engine:
+            assert time.perf_counter() - start < 5
+            expected = target.read_text(encoding="utf-8")
+            assert expected.startswith('var 1a="",22b=g(1a);var 1a=""')
+        else:
+            assert target.read_text(encoding="utf-8") == expected
+
+
+@pytest.mark.parametrize(
+    "piece, count, rules, expected, lastLine",
+    [("foo ", 400000, ["foo=bar"], "bar ", "bar"), ("a", 2000000, ["a=b"], "b", "foo"), ("xfoo ", 200000, ["^foo=1", "x(fo)o$=$1", "x(fo)o=$1"], "fo ", "foo")],
+    ids=["literal", "single-char", "assertion"],
+)
+def test_many_matches_on_one_line(tmp_path: Path, piece: str, count: int, rules: list[str], expected: str, lastLine: str) -> None:
+    # Searching must be linear: The end of the line must not be searched once per match (minified files have millions of matches on one line).
+    target = tmp_path / "t.txt"
+    target.write_text(piece * count + "\nfoo", encoding="utf-8")
+    start = time.perf_counter()
+    run_streplace(rules + ["t.txt"], tmp_path)
+    assert time.perf_counter() - start < 5
+    assert target.read_text(encoding="utf-8") == expected * count + "\n" + lastLine
+
+
+def test_regex_required_literal_prefilter(tmp_path: Path) -> None:
+    streplace = streplace_bin()
+    target = tmp_path / "t.c"
+    target.write_text("old_api_(x);\nold_api_foo(x); old_api_bar(y)\nold_api_2(z)\n", encoding="utf-8")
+
+    result = run_streplace(["-v", "-v", r"old_api_([a-z]+)\(=new_$1(", str(target)], streplace.parent)
+    assert target.read_text(encoding="utf-8") == "old_api_(x);\nnew_foo(x); new_bar(y)\nold_api_2(z)\n"
+    assert '(prefilter "old_api_")' in result.stdout
+
+
+def test_jobs_output_matches_single_thread(tmp_path: Path) -> None:
+    streplace = streplace_bin()
+    trees = []
+    for name in ["j1", "j4"]:
+        root = tmp_path / name / "tree"
+        for d in range(5):
+            sub = root / f"d{d}"
+            sub.mkdir(parents=True)
+            for f in range(20):
+                (sub / f"f{f}.txt").write_text("foo\n" * (f % 3) + "bar\n", encoding="utf-8")
+        trees.append(root)
+
+    results = [run_streplace(["-r", "-A", "-v", "-v", "-j", jobs, "foo=baz", "d3=dir3", "tree"], root.parent)
+               for root, jobs in zip(trees, ["1", "4"])]
+    assert results[1].stdout == results[0].stdout
+    assert results[0].stdout.count("Modifying ") == 5 * 13
+    assert not (trees[1] / "d3").exists()
+    for f in range(20):
+        assert (trees[1] / "dir3" / f"f{f}.txt").read_text(encoding="utf-8") == "baz\n" * (f % 3) + "bar\n"
+
+
+def test_jobs_parallel_traversal_skips_git(tmp_path: Path) -> None:
+    streplace = streplace_bin()
+    for d in ["a/b/c", "a/.git/objects", "d"]:
+        (tmp_path / d).mkdir(parents=True)
+        for f in range(10):
+            (tmp_path / d / f"f{f}").write_text("foo\n", encoding="utf-8")
+
+    run_streplace(["-r", "-j", "3", "foo=bar", "a", "d"], tmp_path)
+    assert (tmp_path / "a/b/c/f9").read_text(encoding="utf-8") == "bar\n"
+    assert (tmp_path / "d/f0").read_text(encoding="utf-8") == "bar\n"
+    assert (tmp_path / "a/.git/objects/f0").read_text(encoding="utf-8") == "foo\n"
+
+    run_streplace(["-r", "-j", "3", "--all", "foo=bar", "a"], tmp_path)
+    assert (tmp_path / "a/.git/objects/f0").read_text(encoding="utf-8") == "bar\n"
+
+
+@pytest.mark.parametrize("maxOpenFiles", [128, 1024])
+def test_jobs_open_file_limit(tmp_path: Path, maxOpenFiles: int) -> None:
+    # Queued entries keep their parent directory open: The queues must stay below the limit of open files.
+    import resource
+
+    streplace = streplace_bin()
+    for d in range(3000):
+        sub = tmp_path / "tree" / f"d{d // 100}" / f"d{d}"
+        sub.mkdir(parents=True)
+        (sub / "f").write_text("foo\n", encoding="utf-8")
+
+    result = subprocess.run(
+        [str(streplace), "-r", "-v", "-j", "16", "foo=bar", "tree"],
+        cwd=tmp_path,
+        capture_output=True,
+        text=True,
+        preexec_fn=lambda: resource.setrlimit(resource.RLIMIT_NOFILE, (maxOpenFiles, maxOpenFiles)),
+    )
+    assert result.returncode == 0, result.stdout + result.stderr
+    assert "3000/3000 files modified" in result.stdout
+
+
+def test_jobs_too_many_open_files_deep_tree(tmp_path: Path) -> None:
+    # Directories listed inline stay open: Entries which cannot be opened anymore (EMFILE) are retried by the pool.
+    import resource
+
+    streplace = streplace_bin()
+    d = tmp_path / "tree"
+    for level in range(300):
+        d = d / "d"
+        d.mkdir(parents=True)
+        (d / "f").write_text("foo\n", encoding="utf-8")
+
+    result = subprocess.run(
+        [str(streplace), "-r", "-v", "-j", "2", "foo=bar", "tree"],
+        cwd=tmp_path,
+        capture_output=True,
+        text=True,
+        preexec_fn=lambda: resource.setrlimit(resource.RLIMIT_NOFILE, (128, 128)),
+    )
+    assert result.returncode == 0, result.stdout + result.stderr
+    assert "300/300 files modified" in result.stdout
+    assert (d / "f").read_text(encoding="utf-8") == "bar\n"
+
+
+@pytest.mark.parametrize("jobs", ["1", "3"])
+def test_rename_deep_tree(tmp_path: Path, jobs: str) -> None:
+    streplace = streplace_bin()
+    d = tmp_path / "x0"
+    for level in range(1, 20):
+        d = d / f"x{level}"
+    d.mkdir(parents=True)
+    (d / "fx").write_text("x\n", encoding="utf-8")
+    os.symlink("fx", d / "lx")
+
+    run_streplace(["-r", "-A", "-j", jobs, "x=y", "x0"], tmp_path)
+    d = tmp_path / "y0"
+    for level in range(1, 20):
+        d = d / f"y{level}"
+    assert (d / "fy").read_text(encoding="utf-8") == "y\n"
+    assert os.readlink(d / "ly") == "fx"
+
+    run_streplace(["-r", "-s", "-j", jobs, "x=z", "y0"], tmp_path)
+    assert os.readlink(d / "ly") == "fz"
+
+
+@pytest.mark.parametrize("io", ["posix", "io_uring"])
+def test_prefetch_pipeline(tmp_path: Path, io: str) -> None:
+    streplace = streplace_bin()
+    trees = []
+    for name in ["plain", "prefetch", "lowmem"]:
+        root = tmp_path / name / "tree"
+        for d in range(3):
+            sub = root / f"d{d}"
+            sub.mkdir(parents=True)
+            for f in range(30):
+                (sub / f"f{f}").write_text("foo\n" * (f % 4) + "x" * (f * 1000), encoding="utf-8")
+            (sub / "big").write_text("foo\n" + "x" * (3 << 20), encoding="utf-8")
+        trees.append(root)
+
+    args = [[], ["--prefetch", "4", "--io", io], ["--prefetch", "8", "--prefetch-memory", "0", "--io", io]]
+    results = [run_streplace(["-r", "-v", "-v"] + extra + ["foo=bar", "tree"], root.parent) for root, extra in zip(trees, args)]
+    stdouts = ["".join(line for line in result.stdout.splitlines(keepends=True) if not line.startswith("I/O engine:")) for result in results]
+    assert stdouts[1] == stdouts[0]
+    assert stdouts[2] == stdouts[0]
+    assert "I/O engine: " in results[1].stdout
+    for root in trees:
+        for f in range(30):
+            assert (root / "d2" / f"f{f}").read_text(encoding="utf-8") == "bar\n" * (f % 4) + "x" * (f * 1000)
+
+    result = run_streplace_result(["-j", "2", "--prefetch", "2", "foo=bar", "tree"], trees[0].parent)
+    assert result.returncode != 0
+    assert "--prefetch" in result.stdout
+
+
+@pytest.mark.parametrize("extra", [[], ["--fsync", "1"], ["--fsync", "3"], ["-j", "3", "--fsync", "2"], ["--prefetch", "4", "--fsync", "2"]])
+def test_atomic_write(tmp_path: Path, extra: list[str]) -> None:
+    streplace = streplace_bin()
+    tree = tmp_path / "tree"
+    tree.mkdir()
+    for i in range(10):
+        (tree / f"f{i}").write_text(f"foo {i}\n", encoding="utf-8")
+    (tree / "f0").chmod(0o640)
+    (tree / "f1").chmod(0o755)
+    os.link(tree / "f2", tree / "hardlink")
+    os.symlink("f3", tree / "symlink")
+    inode = (tree / "f0").stat().st_ino
+
+    run_streplace(["-r", "-l", "--atomic"] + extra + ["foo=bar", "tree"], tmp_path)
+
+    for i in range(10):
+        assert (tree / f"f{i}").read_text(encoding="utf-8") == f"bar {i}\n"
+    # Replaced by a new file with the same mode.
+    assert (tree / "f0").stat().st_ino != inode
+    assert (tree / "f0").stat().st_mode & 0o777 == 0o640
+    assert (tree / "f1").stat().st_mode & 0o777 == 0o755
+    # Hardlinks and symlinks are kept.
+    assert (tree / "f2").stat().st_ino == (tree / "hardlink").stat().st_ino
+    assert (tree / "symlink").is_symlink()
+    assert sorted(p.name for p in tree.iterdir()) == sorted([f"f{i}" for i in range(10)] + ["hardlink", "symlink"])
+
+
+@pytest.fixture
+def foreign_dir() -> Path:
+    # A directory which an unprivileged user can write to and which contains a copy of streplace it can run.
+    if os.geteuid() != 0:
+        pytest.skip("needs root to run streplace as another user")
+    import shutil
+    import tempfile
+    path = Path(tempfile.mkdtemp(prefix="streplace-foreign-"))
+    path.chmod(0o777)
+    shutil.copy(streplace_bin(), path / "streplace")
+    yield path
+    shutil.rmtree(path)
+
+
+def run_streplace_as_nobody(args: list[str], cwd: Path) -> subprocess.CompletedProcess[str]:
+    def drop_privileges() -> None:
+        os.setgroups([])
+        os.setgid(65534)
+        os.setuid(65534)
+    return subprocess.run([str(cwd / "streplace")] + args, cwd=cwd, check=True, capture_output=True, text=True, preexec_fn=drop_privileges)
+
+
+@pytest.mark.parametrize("extra", [["--atomic"], ["--atomic", "-j", "2"], ["--atomic", "--prefetch", "2"]])
+def test_atomic_write_keeps_foreign_owner(foreign_dir: Path, extra: list[str]) -> None:
+    # A file of another user which is writable but whose owner cannot be copied is written in place.
+    path = foreign_dir / "f"
+    path.write_text("foo\n", encoding="utf-8")
+    path.chmod(0o666)
+    inode = path.stat().st_ino
+
+    run_streplace_as_nobody(extra + ["foo=bar", "f"], foreign_dir)
+
+    assert path.read_text(encoding="utf-8") == "bar\n"
+    assert (path.stat().st_uid, path.stat().st_gid) == (0, 0)
+    assert path.stat().st_ino == inode
+    assert sorted(p.name for p in foreign_dir.iterdir()) == ["f", "streplace"]
+
+
+@pytest.mark.parametrize("extra", [["--window", "1"], ["--window", "1", "-j", "2"]])
+def test_window_keeps_foreign_owner(foreign_dir: Path, extra: list[str]) -> None:
+    # --window writes into a temporary file too, so files of other users are processed as a whole and written in place.
+    path = foreign_dir / "f"
+    path.write_bytes(b"foo bar\n" * (1 << 18))
+    path.chmod(0o666)
+    inode = path.stat().st_ino
+
+    run_streplace_as_nobody(extra + ["foo=bar", "f"], foreign_dir)
+
+    assert path.read_bytes() == b"bar bar\n" * (1 << 18)
+    assert (path.stat().st_uid, path.stat().st_gid) == (0, 0)
+    assert path.stat().st_ino == inode
+    assert sorted(p.name for p in foreign_dir.iterdir()) == ["f", "streplace"]
+
+
+@pytest.mark.parametrize("extra", [[], ["-j", "2"], ["--prefetch", "2"]])
+def test_equal_length_patch_keeps_holes(tmp_path: Path, extra: list[str]) -> None:
+    streplace = streplace_bin()
+    path = tmp_path / "image.bin"
+    size = 64 << 20
+    with open(path, "wb") as f:
+        f.write(b"version 1.2.3\0")
+        f.seek(size - 14)
+        f.write(b"version 1.2.3\0")
+    blocks = path.stat().st_blocks
+    inode = path.stat().st_ino
+
+    run_streplace(extra + ["-x", "version 1.2.3=version 4.5.6", "image.bin"], tmp_path)
+
+    data = path.read_bytes()
+    assert len(data) == size
+    assert data.startswith(b"version 4.5.6\0")
+    assert data.endswith(b"version 4.5.6\0")
+    assert data.count(b"\0") == size - 26
+    # Only the changed bytes were written: The file is still sparse and was not replaced.
+    assert path.stat().st_blocks <= blocks + 64
+    assert path.stat().st_ino == inode
+
+    run_streplace(extra + ["--atomic", "-x", "version 4.5.6=version 7.8.9", "image.bin"], tmp_path)
+    assert path.read_bytes().endswith(b"version 7.8.9\0")
+    assert path.stat().st_ino != inode
+
+
+@pytest.mark.parametrize("extra", [[], ["-j", "3"], ["--prefetch", "4"], ["--atomic"]])
+def test_backup_and_restore(tmp_path: Path, extra: list[str]) -> None:
+    streplace = streplace_bin()
+    tree = tmp_path / "tree"
+    (tree / "sub").mkdir(parents=True)
+    for name in ["a", "b", "sub/c"]:
+        (tree / name).write_text(f"foo {name}\n", encoding="utf-8")
+    (tree / "unchanged").write_text("nothing\n", encoding="utf-8")
+    (tree / "a").chmod(0o600)
+
+    run_streplace(["-r", "-b"] + extra + ["foo=bar", "tree"], tmp_path)
+    assert (tree / "a").read_text(encoding="utf-8") == "bar a\n"
+    assert (tree / "a.~sub~").read_text(encoding="utf-8") == "foo a\n"
+    assert (tree / "a.~sub~").stat().st_mode & 0o777 == 0o600
+    assert (tree / "sub" / "c.~sub~").read_text(encoding="utf-8") == "foo sub/c\n"
+    assert not (tree / "unchanged.~sub~").exists()
+
+    # Existing backups are kept and backup files are not processed.
+    run_streplace(["-r", "-b"] + extra + ["bar=baz", "foo=qux", "tree"], tmp_path)
+    assert (tree / "a").read_text(encoding="utf-8") == "baz a\n"
+    assert (tree / "a.~sub~").read_text(encoding="utf-8") == "foo a\n"
+
+    result = run_streplace(["-r", "-v", "--restore"] + extra + ["tree"], tmp_path)
+    assert "3 files restored" in result.stdout
+    for name in ["a", "b", "sub/c"]:
+        assert (tree / name).read_text(encoding="utf-8") == f"foo {name}\n"
+    assert sorted(p.name for p in tree.rglob("*")) == ["a", "b", "c", "sub", "unchanged"]
+
+    run_streplace(["-r", "-b", "-S", ".orig"] + extra + ["foo=bar", "tree"], tmp_path)
+    assert (tree / "b.orig").read_text(encoding="utf-8") == "foo b\n"
+
+    result = run_streplace_result(["--restore", "foo=bar", "tree"], tmp_path)
+    assert result.returncode != 0
+
+
+@pytest.mark.parametrize("extra", [[], ["-x"], ["--engine", "std"], ["-j", "2"], ["--prefetch", "2"]])
+def test_matched_but_unchanged_is_not_written(tmp_path: Path, extra: list[str]) -> None:
+    streplace = streplace_bin()
+    same = tmp_path / "same.txt"
+    undo = tmp_path / "undo.txt"
+    changed = tmp_path / "changed.txt"
+    for path in [same, undo, changed]:
+        path.write_text("foo bar\n", encoding="utf-8")
+        os.utime(path, (1000000000, 1000000000))
+
+    result = run_streplace(["-v"] + extra + ["foo=foo", "same.txt"], tmp_path)
+    assert "Matched but unchanged same.txt (1 matches)" in result.stdout
+    assert "0/1 files modified, 1 file matched but unchanged" in result.stdout
+    assert same.stat().st_mtime == 1000000000
+
+    if "-x" not in extra:
+        # Rules undoing each other (-x applies all rules in a single pass, so they cannot undo each other).
+        run_streplace(extra + ["foo=X", "X=foo", "undo.txt"], tmp_path)
+        assert undo.stat().st_mtime == 1000000000
+
+    run_streplace(extra + ["foo=baz", "changed.txt"], tmp_path)
+    assert changed.read_text(encoding="utf-8") == "baz bar\n"
+    assert changed.stat().st_mtime != 1000000000
+
+
+@pytest.mark.parametrize(
+    "rules, split",
+    [
+        (["foo=bar", "o+b=X", "\\bba[rz]\\b=$&$&"], "after newlines"),
+        (["-x", "-i", "ab\ncd=X", "CD=Y", "aa=b"], "between literal matches"),
+        (["-x", "-w", "aa=b"], "between literal matches"),
+        (["b\\ncd=X"], "overlapping by the longest match"),
+        (["[^a-z]foo[^a-z]=<$&>"], "overlapping by the longest match"),
+        (["[ab]\\s?[ab]=X"], "overlapping by the longest match"),
+        (["b\\s*cd=X"], "none (files are processed as a whole)"),
+        (["^foo=X"], "none (files are processed as a whole)"),
+    ],
+)
+@pytest.mark.parametrize("extra", [[], ["-j", "2"], ["--prefetch", "2"]])
+def test_window_matches_whole_file(tmp_path: Path, rules: list[str], split: str, extra: list[str]) -> None:
+    streplace = streplace_bin()
+    pieces = [b"foo baz\n", b"ab\ncd ", b"aaa", b"fooob ", b"\n", b"bar\n", b"aab aa ", b"xyz" * 50]
+    data = b"".join(pieces[(i * 7919) % 1000 % len(pieces)] for i in range(300000))
+    data += b"a" * 3000000 + b"\n"
+    whole = tmp_path / "whole.txt"
+    windowed = tmp_path / "windowed.txt"
+    whole.write_bytes(data)
+    windowed.write_bytes(data)
+
+    run_streplace(extra + rules + ["whole.txt"], tmp_path)
+    result = run_streplace(["-vv", "--window", "1"] + extra + rules + ["windowed.txt"], tmp_path)
+    assert f"Window split: {split}\n" in result.stdout
+    assert ("Warning: --window is ignored" in result.stderr) == split.startswith("none")
+    assert whole.read_bytes() != data
+    assert windowed.read_bytes() == whole.read_bytes()
+    assert not [p.name for p in tmp_path.iterdir() if p.name.endswith(".tmp")]
+
+
+def test_window_bounds_memory(tmp_path: Path) -> None:
+    streplace = streplace_bin()
+    target = tmp_path / "big.txt"
+    target.write_bytes(b"foo bar baz\n" * (4 * 1024 * 1024))
+    measure = "import resource, subprocess, sys; subprocess.run(sys.argv[1:], check=True); print(resource.getrusage(resource.RUSAGE_CHILDREN).ru_maxrss)"
+
+    def max_rss_kb(args: list[str]) -> int:
+        result = subprocess.run(["python3", "-c", measure, str(streplace)] + args + ["bar=quux", str(target)], check=True, capture_output=True, text=True)
+        return int(result.stdout.split()[-1])
+
+    assert max_rss_kb(["--window", "1"]) < 16 * 1024
+    assert target.read_bytes() == b"foo quux baz\n" * (4 * 1024 * 1024)
+    # Without --window the whole file (48 MB) is mapped and the result is built in memory.
+    assert max_rss_kb(["quux=bar"]) > 48 * 1024
+
+
+@pytest.mark.parametrize("rules", [["foo=X", "o+b=Y"], ["-x", "ab\ncd=X", "aa=b"], ["b\\ncd=X"], ["[ab]\\s?[ab]=X"], ["b\\s*cd=X"], ["-P", "foo=X"]])
+def test_stdin_filter(tmp_path: Path, rules: list[str]) -> None:
+    streplace = streplace_bin()
+    pieces = [b"foo baz\n", b"ab\ncd ", b"aaa", b"fooob ", b"\n", b"xyz" * 50]
+    data = b"".join(pieces[(i * 7919) % 1000 % len(pieces)] for i in range(300000))
+    target = tmp_path / "t.txt"
+    target.write_bytes(data)
+
+    result = subprocess.run([str(streplace), "-v"] + rules + ["-"], input=data, capture_output=True, check=True)
+    assert b"Modifying <stdin>" in result.stderr
+    # Only rules whose matches are not bounded in length need all input at once.
+    assert (b"Warning: All input is read" in result.stderr) == ("b\\s*cd=X" in rules)
+    if "-P" in rules:
+        # Preview only.
+        assert result.stdout == b""
+        return
+    run_streplace(rules + ["t.txt"], tmp_path)
+    assert result.stdout == target.read_bytes()
+    assert result.stdout != data
+
+
+def test_stdin_filter_is_incremental(tmp_path: Path) -> None:
+    streplace = streplace_bin()
+    process = subprocess.Popen([str(streplace), "foo=bar", "-"], stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+    try:
+        # Each line is written as soon as it is complete, long before the end of the input.
+        for i in range(3):
+            process.stdin.write(f"foo {i}\n".encode())
+            process.stdin.flush()
+            assert process.stdout.readline() == f"bar {i}\n".encode()
+        process.stdin.write(b"foo")
+        process.stdin.close()
+        assert process.stdout.read() == b"bar"
+        assert process.wait(timeout=10) == 0
+    finally:
+        process.kill()
+
+
+def test_stdin_filter_is_incremental_across_lines(tmp_path: Path) -> None:
+    streplace = streplace_bin()
+    process = subprocess.Popen([str(streplace), "a\\sb=X", "-"], stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+    try:
+        # The rule can match a newline, so only the input up to its last 3 bytes (the longest match) can be written before more input arrives.
+        process.stdin.write(b"a\nb a\n")
+        process.stdin.flush()
+        assert process.stdout.read(1) == b"X"
+        process.stdin.write(b"b.")
+        process.stdin.close()
+        assert process.stdout.read() == b" X."
+        assert process.wait(timeout=10) == 0
+    finally:
+        process.kill()
+
+
+def test_stdin_filter_errors(tmp_path: Path) -> None:
+    (tmp_path / "t.txt").write_text("foo\n", encoding="utf-8")
+    assert run_streplace_result(["foo=bar", "-", "t.txt"], tmp_path).returncode != 0
+    assert run_streplace_result(["-N", "foo=bar", "-"], tmp_path).returncode != 0
+    # "--" makes "-" a file name.
+    (tmp_path / "-").write_text("foo\n", encoding="utf-8")
+    run_streplace(["foo=bar", "--", "-"], tmp_path)
+    assert (tmp_path / "-").read_text(encoding="utf-8") == "bar\n"
+
+
+def test_line_mode(tmp_path: Path) -> None:
+    target = tmp_path / "t.txt"
+    target.write_text("foo bar\nbar foo\n\nfoo x\nfoo", encoding="utf-8")
+    run_streplace(["--line-mode", "^foo=X", "o$=Y", "^$=E", "[^x]+x=Z", "t.txt"], tmp_path)
+    # ^ and $ match at each line, matches do not span lines and the newlines are kept.
+    assert target.read_text(encoding="utf-8") == "X bar\nbar foY\nE\nZ\nX"
+
+
+@pytest.mark.parametrize("rules", [["^foo=X", "o\\n?b=Y"], ["foo=bar", "o+b=X"], ["-x", "fooob=X"]])
+@pytest.mark.parametrize("extra", [["-j", "3"], ["-j", "2", "--window", "1"], ["--prefetch", "2"]])
+def test_line_mode_chunks_match_whole_file(tmp_path: Path, rules: list[str], extra: list[str]) -> None:
+    streplace = streplace_bin()
+    pieces = [b"foo baz\n", b"ab\ncd ", b"aaa", b"fooob ", b"\n", b"bar\n", b"xyz" * 50]
+    data = b"".join(pieces[(i * 7919) % 1000 % len(pieces)] for i in range(300000))
+    whole = tmp_path / "whole.txt"
+    chunked = tmp_path / "chunked.txt"
+    whole.write_bytes(data)
+    chunked.write_bytes(data)
+
+    run_streplace(["--line-mode"] + rules + ["whole.txt"], tmp_path)
+    run_streplace(["--line-mode"] + extra + rules + ["chunked.txt"], tmp_path)
+    assert whole.read_bytes() != data
+    assert chunked.read_bytes() == whole.read_bytes()
+    result = subprocess.run([str(streplace), "--line-mode"] + rules + ["-"], input=data, capture_output=True, check=True)
+    assert result.stdout == whole.read_bytes()
+
+
+@pytest.mark.parametrize("option, pattern", [("--select-lines", "^\\s*#include"), ("--ignore-lines", "#include"), ("--select-lines", "^#incl(ude)\\1?")])
+@pytest.mark.parametrize("extra", [[], ["-j", "3"], ["--window", "1"]])
+def test_select_lines(tmp_path: Path, option: str, pattern: str, extra: list[str]) -> None:
+    lines = [f'#include "mod{i}.h"' if i % 7 == 0 else f"  #include <x{i}.h>" if i % 11 == 0 else f"int v{i} = f(a.h); // {i}.h" for i in range(100000)]
+    data = "\n".join(lines) + "\n\n.h"
+    target = tmp_path / "gen.cpp"
+    target.write_text(data, encoding="utf-8")
+
+    run_streplace([option, pattern] + extra + ["\\.h\\b=.hpp", "^$=//", "t\\b=T", "gen.cpp"], tmp_path)
+    expected = []
+    for line in data.split("\n"):
+        selected = re.search(pattern.replace("\\1?", ""), line) is not None
+        if selected != (option == "--ignore-lines"):
+            line = re.sub(r"t\b", "T", re.sub(r"^$", "//", re.sub(r"\.h\b", ".hpp", line)))
+        expected.append(line)
+    assert target.read_text(encoding="utf-8") == "\n".join(expected)
+
+
+def test_select_lines_errors(tmp_path: Path) -> None:
+    (tmp_path / "t.txt").write_text("foo\n", encoding="utf-8")
+    assert run_streplace_result(["--select-lines", "a", "--ignore-lines", "b", "foo=bar", "t.txt"], tmp_path).returncode != 0
+    assert run_streplace_result(["--select-lines", "(", "foo=bar", "t.txt"], tmp_path).returncode != 0
+    assert (tmp_path / "t.txt").read_text(encoding="utf-8") == "foo\n"
+
+
+def test_no_match_cache(tmp_path: Path) -> None:
+    tree = tmp_path / "tree"
+    tree.mkdir()
+    for i in range(20):
+        (tree / f"f{i}").write_text(f"hello {i}\n", encoding="utf-8")
+    # Files modified just before the cache is opened are not recorded (a later change might keep mtime/ctime).
+    time.sleep(1.1)
+    cache = ["--cache-file", str(tmp_path / "cache" / "no-match")]
+
+    assert "skipped" not in run_streplace(["-v", "-r"] + cache + ["foo=bar", "tree"], tmp_path).stdout
+    assert "20 files skipped (no match cached)" in run_streplace(["-v", "-r"] + cache + ["foo=quux", "tree"], tmp_path).stdout
+    # Same size, so only mtime/ctime show the change.
+    (tree / "f3").write_text("foo 3xx\n", encoding="utf-8")
+    result = run_streplace(["-v", "-r"] + cache + ["foo=bar", "tree"], tmp_path)
+    assert "19 files skipped (no match cached)" in result.stdout
+    assert (tree / "f3").read_text(encoding="utf-8") == "bar 3xx\n"
+    assert "skipped" not in run_streplace(["-v", "-r"] + cache + ["-i", "foo=bar", "tree"], tmp_path).stdout
+    assert "skipped" not in run_streplace(["-v", "-r", "--no-cache"] + cache + ["foo=bar", "tree"], tmp_path).stdout
+
+
+@pytest.mark.parametrize("extra", [["-d"], ["-P"], ["-N"], ["--no-cache"]])
+def test_no_match_cache_only_when_modifying(tmp_path: Path, extra: list[str]) -> None:
+    target = tmp_path / "t.txt"
+    target.write_text("hello\n", encoding="utf-8")
+    time.sleep(1.1)  # Files modified just before the cache is opened are not recorded.
+    cache = tmp_path / "xdg" / "streplace" / "no-match-cache"
+    env = dict(os.environ, XDG_CACHE_HOME=str(tmp_path / "xdg"))
+
+    subprocess.run([str(streplace_bin())] + extra + ["foo=bar", "t.txt"], cwd=tmp_path, env=env, check=True, capture_output=True)
+    assert not cache.exists()
+    subprocess.run([str(streplace_bin()), "foo=bar", "t.txt"], cwd=tmp_path, env=env, check=True, capture_output=True)
+    assert cache.exists()